@@ -3,9 +3,18 @@
 
 namespace cmd {
 
-constexpr std::string HELP = "help";
-constexpr std::string RUN  = "run";
-constexpr std::string REPL = "repl";
-constexpr std::string EXIT = "exit";
+constexpr std::string HELP           = "help";
+constexpr std::string RUN            = "run";
+constexpr std::string REPL           = "repl";
+constexpr std::string CHECK          = "check";
+constexpr std::string WATCH          = "--watch";
+constexpr std::string DUMP_OPT       = "--dump-opt";
+constexpr std::string INLINE_LIMIT   = "--inline-limit=";
+constexpr std::string ENGINE         = "--engine=";
+constexpr std::string ENGINE_TREE    = "tree";
+constexpr std::string ENGINE_VM      = "vm";
+constexpr std::string ENGINE_CLOSURE = "closure";
+constexpr std::string JIT            = "--jit";
+constexpr std::string EXIT           = "exit";
 
 } // namespace cmd
\ No newline at end of file
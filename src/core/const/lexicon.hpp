@@ -0,0 +1,206 @@
+#pragma once
+
+#include "const/characters.hpp"
+#include "types/token_t.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+/**
+ * Scanner tables generated at compile time from the constants in characters.hpp.
+ * A character class table drives the main scanning loop and a perfect hash maps
+ * keywords to their token type with a single probe.
+ */
+namespace lexicon {
+
+enum class CharKind : uint8_t {
+    INVALID,
+    NEWLINE,
+    BLANK,
+    SINGLE,      // always a one character token
+    PAIRED,      // a different token when followed by `follow`, e.g. '=' and "=="
+    SLASH,       // division or the start of a comment
+    QUOTE,       // start of a string
+    DIGIT,       // start of a number
+    IDENT_START, // start of an identifier or keyword
+};
+
+struct CharClass {
+    CharKind  kind       = CharKind::INVALID;
+    TokenType single     = TokenType::END;
+    TokenType paired     = TokenType::END;
+    char      follow     = 0;
+    bool      ident_char = false;
+};
+
+constexpr std::array<CharClass, 256> CHAR_TABLE = [] {
+    std::array<CharClass, 256> table{};
+    const auto at = [&table](const char c) -> CharClass& { return table[static_cast<unsigned char>(c)]; };
+
+    for(char c = 'a'; c <= 'z'; c++)
+        at(c) = {.kind = CharKind::IDENT_START, .ident_char = true};
+    for(char c = 'A'; c <= 'Z'; c++)
+        at(c) = {.kind = CharKind::IDENT_START, .ident_char = true};
+    at('_') = {.kind = CharKind::IDENT_START, .ident_char = true};
+    for(char c = '0'; c <= '9'; c++)
+        at(c) = {.kind = CharKind::DIGIT, .ident_char = true};
+
+    at(delimiter::NEWLINE) = {.kind = CharKind::NEWLINE};
+    at(delimiter::SPACE)   = {.kind = CharKind::BLANK};
+    at(delimiter::TAB)     = {.kind = CharKind::BLANK};
+
+    const std::pair<char, TokenType> singles[] = {
+        {symbol::LeftParen, TokenType::LEFT_PAREN},
+        {symbol::RightParen, TokenType::RIGHT_PAREN},
+        {symbol::LeftBrace, TokenType::LEFT_BRACE},
+        {symbol::RightBrace, TokenType::RIGHT_BRACE},
+        {symbol::Plus, TokenType::PLUS},
+        {symbol::Comma, TokenType::COMMA},
+        {symbol::Dot, TokenType::DOT},
+        {symbol::Semicolon, TokenType::SEMICOLON},
+        {symbol::Star, TokenType::STAR},
+        {symbol::Percent, TokenType::PERCENT},
+    };
+    for(const auto& [c, type] : singles)
+        at(c) = {.kind = CharKind::SINGLE, .single = type};
+
+    at(symbol::Minus) = {
+        .kind   = CharKind::PAIRED,
+        .single = TokenType::MINUS,
+        .paired = TokenType::ARROW,
+        .follow = op::Arrow[1],
+    };
+    at(op::Bang) = {
+        .kind   = CharKind::PAIRED,
+        .single = TokenType::BANG,
+        .paired = TokenType::BANG_EQUAL,
+        .follow = op::BangEqual[1],
+    };
+    at(op::Equal) = {
+        .kind   = CharKind::PAIRED,
+        .single = TokenType::EQUAL,
+        .paired = TokenType::EQUAL_EQUAL,
+        .follow = op::EqualEqual[1],
+    };
+    at(op::Greater) = {
+        .kind   = CharKind::PAIRED,
+        .single = TokenType::GREATER,
+        .paired = TokenType::GREATER_EQUAL,
+        .follow = op::GreaterEqual[1],
+    };
+    at(op::Less) = {
+        .kind   = CharKind::PAIRED,
+        .single = TokenType::LESS,
+        .paired = TokenType::LESS_EQUAL,
+        .follow = op::LessEqual[1],
+    };
+
+    at(symbol::Slash)         = {.kind = CharKind::SLASH, .single = TokenType::SLASH};
+    at(surround::DoubleQuote) = {.kind = CharKind::QUOTE};
+    return table;
+}();
+
+constexpr const CharClass& char_class(const char c) {
+    return CHAR_TABLE[static_cast<unsigned char>(c)];
+}
+
+constexpr bool is_digit(const char c) {
+    return char_class(c).kind == CharKind::DIGIT;
+}
+
+constexpr bool is_identifier_start(const char c) {
+    return char_class(c).kind == CharKind::IDENT_START;
+}
+
+constexpr bool is_identifier_char(const char c) {
+    return char_class(c).ident_char;
+}
+
+struct Keyword {
+    std::string_view text;
+    TokenType        type = TokenType::IDENTIFIER;
+};
+
+constexpr std::array<Keyword, 17> KEYWORDS = {{
+    {keyword::And, TokenType::AND},
+    {keyword::Or, TokenType::OR},
+    {keyword::If, TokenType::IF},
+    {keyword::Else, TokenType::ELSE},
+    {keyword::True, TokenType::TRUE},
+    {keyword::False, TokenType::FALSE},
+    {keyword::Class, TokenType::CLASS},
+    {keyword::This, TokenType::THIS},
+    {keyword::Super, TokenType::SUPER},
+    {keyword::Fun, TokenType::FUN},
+    {keyword::Var, TokenType::VAR},
+    {keyword::For, TokenType::FOR},
+    {keyword::While, TokenType::WHILE},
+    {keyword::Break, TokenType::BREAK},
+    {keyword::Continue, TokenType::CONTINUE},
+    {keyword::Return, TokenType::RETURN},
+    {keyword::Nil, TokenType::NIL},
+}};
+
+constexpr size_t KEYWORD_SLOTS = 64;
+
+/* Hash over the length and the first two and last characters, `seed` is searched at compile time */
+constexpr size_t keyword_hash(const std::string_view text, const uint32_t seed) {
+    const auto first  = static_cast<unsigned char>(text[0]);
+    const auto second = static_cast<unsigned char>(text[1]);
+    const auto last   = static_cast<unsigned char>(text[text.size() - 1]);
+    return ((first * seed) ^ (second * (seed >> 5)) ^ (last << 1) ^ text.size()) % KEYWORD_SLOTS;
+}
+
+constexpr uint32_t KEYWORD_SEED = [] {
+    for(uint32_t seed = 1; seed < 1 << 16; seed++) {
+        std::array<bool, KEYWORD_SLOTS> used{};
+        bool                             collision = false;
+        for(const auto& [text, type] : KEYWORDS) {
+            const auto slot = keyword_hash(text, seed);
+            collision       = collision || used[slot];
+            used[slot]      = true;
+        }
+        if(!collision)
+            return seed;
+    }
+    return 0u;
+}();
+static_assert(KEYWORD_SEED != 0, "No perfect hash seed found for the keyword set");
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> KEYWORD_TABLE = [] {
+    std::array<Keyword, KEYWORD_SLOTS> table{};
+    for(const auto& keyword : KEYWORDS)
+        table[keyword_hash(keyword.text, KEYWORD_SEED)] = keyword;
+    return table;
+}();
+
+constexpr size_t KEYWORD_MIN_LENGTH = [] {
+    size_t length = KEYWORDS[0].text.size();
+    for(const auto& keyword : KEYWORDS)
+        length = std::min(length, keyword.text.size());
+    return length;
+}();
+
+constexpr size_t KEYWORD_MAX_LENGTH = [] {
+    size_t length = 0;
+    for(const auto& keyword : KEYWORDS)
+        length = std::max(length, keyword.text.size());
+    return length;
+}();
+
+/* Returns the keyword token type for the text, or IDENTIFIER when it is not a keyword */
+constexpr TokenType keyword_type(const std::string_view text) {
+    if(text.size() < KEYWORD_MIN_LENGTH || text.size() > KEYWORD_MAX_LENGTH)
+        return TokenType::IDENTIFIER;
+    const auto& [keyword, type] = KEYWORD_TABLE[keyword_hash(text, KEYWORD_SEED)];
+    return keyword == text ? type : TokenType::IDENTIFIER;
+}
+
+static_assert(keyword_type("continue") == TokenType::CONTINUE);
+static_assert(keyword_type("or") == TokenType::OR);
+static_assert(keyword_type("nil?") == TokenType::IDENTIFIER);
+
+} // namespace lexicon
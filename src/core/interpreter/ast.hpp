@@ -0,0 +1,356 @@
+#pragma once
+
+#include "utils/symbol.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+/**
+ * Nodes reference each other through 32-bit indices into the arena of the Ast that owns them.
+ * NONE marks an absent child, such as a missing else branch.
+ */
+enum class ExprId : uint32_t { NONE = std::numeric_limits<uint32_t>::max() };
+enum class StmtId : uint32_t { NONE = std::numeric_limits<uint32_t>::max() };
+
+/* Index of a string literal in the Ast string pool */
+enum class StringId : uint32_t {};
+
+/* Index of a function or lambda body in the Ast body table */
+enum class BodyId : uint32_t {};
+
+/* A contiguous run of items stored in one of the Ast list pools */
+template <class T>
+struct NodeList {
+    uint32_t begin = 0;
+    uint32_t size  = 0;
+};
+
+/* Slot of names declared at the top level, which live in the global environment under their symbol */
+constexpr uint32_t GLOBAL_SLOT = std::numeric_limits<uint32_t>::max();
+
+/**
+ * A declared name with the line it was declared on, used for duplicate declaration errors,
+ * and the slot of its scope the resolver bound it to.
+ */
+struct Name {
+    Symbol   symbol;
+    int      line = 0;
+    uint32_t slot = GLOBAL_SLOT;
+};
+
+/* Where a local lives: `depth` scopes out from the one referring to it, at `slot` of that scope */
+struct Coord {
+    uint32_t depth = 0;
+    uint32_t slot  = 0;
+};
+
+enum class BinaryOp : uint8_t {
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    MODULO,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+};
+
+enum class UnaryOp : uint8_t {
+    NEGATE,
+    NOT,
+};
+
+enum class LogicalOp : uint8_t {
+    AND,
+    OR,
+};
+
+/**
+ * What a binary expression specialized itself to, from the operands of its first evaluation. A specialized
+ * node checks its operands still have those types and applies the operator directly, it turns GENERIC for
+ * good the first time they do not.
+ */
+enum class Specialization : uint8_t {
+    UNSEEN,
+    GENERIC,
+    ADD_NUM,
+    SUBTRACT_NUM,
+    MULTIPLY_NUM,
+    DIVIDE_NUM,
+    MODULO_NUM,
+    GREATER_NUM,
+    GREATER_EQUAL_NUM,
+    LESS_NUM,
+    LESS_EQUAL_NUM,
+    EQUAL_NUM,
+    NOT_EQUAL_NUM,
+    CONCAT_STR,
+};
+
+struct ExprStmt;
+struct IfStmt;
+struct VarDeclStmt;
+struct FuncDeclStmt;
+struct BlockStmt;
+struct WhileStmt;
+struct BreakStmt;
+struct ContinueStmt;
+struct ReturnStmt;
+
+struct Binary;
+struct Unary;
+struct Grouping;
+struct Variable;
+struct Assign;
+struct Logical;
+struct Call;
+struct Lambda;
+struct Inline;
+struct Param;
+struct Hoisted;
+using Literal = std::variant<std::nullptr_t, double, StringId, bool>;
+
+struct ExprStmt {
+    ExprId expr = ExprId::NONE;
+};
+
+struct IfStmt {
+    ExprId condition;
+    StmtId then_branch;
+    StmtId else_branch = StmtId::NONE;
+};
+
+struct VarDeclStmt {
+    Name   name;
+    ExprId initializer = ExprId::NONE;
+};
+
+struct FuncDeclStmt {
+    Name           name;
+    NodeList<Name> params;
+    BodyId         body;
+};
+
+/* A scope is `captured` when a closure created in it may outlive it, it then needs a heap environment */
+struct BlockStmt {
+    NodeList<StmtId> statements;
+    uint32_t         slots    = 0;
+    bool             captured = false;
+};
+
+/* `hoisted` names the invariants the Optimizer moved out of the loop, kept in an environment of the loop's own */
+struct WhileStmt {
+    ExprId         condition;
+    StmtId         body;
+    NodeList<Name> hoisted{};
+    bool           captured = false;
+};
+
+struct BreakStmt {};
+struct ContinueStmt {};
+
+struct ReturnStmt {
+    ExprId value = ExprId::NONE;
+};
+
+/* `specialization` is rewritten by the interpreter while the program runs, see Specialization */
+struct Binary {
+    ExprId                 left;
+    BinaryOp               op;
+    ExprId                 right;
+    mutable Specialization specialization = Specialization::UNSEEN;
+};
+
+struct Unary {
+    UnaryOp op;
+    ExprId  right;
+};
+
+struct Grouping {
+    ExprId expr;
+};
+
+/**
+ * A scope only holds a local once its declaration ran, so a reference keeps every enclosing scope declaring
+ * the name, innermost first. The first one holding it wins, the globals are looked up when none does.
+ */
+struct Variable {
+    Symbol          name;
+    NodeList<Coord> coords{};
+};
+
+struct Assign {
+    Symbol          name;
+    ExprId          value;
+    NodeList<Coord> coords{};
+};
+
+struct Logical {
+    ExprId    left;
+    LogicalOp op;
+    ExprId    right;
+};
+
+/* `tail` is set by the Resolver on calls whose value is the value of the function making them */
+struct Call {
+    ExprId           callee;
+    NodeList<ExprId> args;
+    bool             tail = false;
+};
+
+struct Lambda {
+    NodeList<Name> params;
+    BodyId         body;
+};
+
+/**
+ * A call of a small top level function whose body the Inliner substituted, reading the arguments as Params.
+ * `call` is the original call, evaluated instead when the callee is no longer the function that was inlined.
+ */
+struct Inline {
+    ExprId   call;
+    ExprId   body;
+    uint32_t target;
+};
+
+/* Argument `index` of the inlined call being evaluated */
+struct Param {
+    uint32_t index;
+};
+
+/**
+ * A loop invariant expression, evaluated the first time the loop entered needs it. Its value is then kept in
+ * the slot the Resolver gave `name` among the loop's hoisted names, until the loop is entered again.
+ */
+struct Hoisted {
+    ExprId expr;
+    Symbol name;
+    Coord  coord{};
+};
+
+using Stmt = std::
+    variant<ExprStmt, IfStmt, VarDeclStmt, FuncDeclStmt, BlockStmt, WhileStmt, BreakStmt, ContinueStmt, ReturnStmt>;
+
+using Expr =
+    std::variant<Binary, Grouping, Unary, Literal, Variable, Assign, Logical, Call, Lambda, Inline, Param, Hoisted>;
+
+class Ast;
+struct Scope;
+
+/**
+ * Statements of a function or lambda body. A deferred body was only checked for errors when the program
+ * was parsed, it is parsed from `source` on its first call into an arena of its own, see Parser::function_body.
+ */
+struct FuncBody {
+    mutable NodeList<StmtId> statements{};
+    /* Arena holding the statements once a deferred body is parsed, null when they are in the owning Ast */
+    mutable std::shared_ptr<Ast> ast{};
+    mutable bool                 deferred = false;
+
+    /* Slots of the call environment, and the scope a deferred body is resolved in on its first call */
+    mutable uint32_t               slots    = 0;
+    mutable bool                   resolved = false;
+    mutable bool                   captured = false;
+    mutable std::shared_ptr<Scope> scope{};
+
+    /* Where the deferred body starts, right after its '{', and the parser state it starts in */
+    std::string_view source{};
+    size_t           offset     = 0;
+    int              line       = 0;
+    int              loop_depth = 0;
+};
+
+/**
+ * Arena owning every node of a parsed program.
+ * Nodes live in contiguous vectors and refer to each other by index, the source line of each
+ * expression is kept in a side table next to it. The whole tree is released at once with the Ast.
+ * Nodes may be rewritten in place, but an Ast must not grow while it is being executed.
+ */
+class Ast : public std::enable_shared_from_this<Ast> {
+    std::vector<Expr>        exprs;
+    std::vector<int>         expr_lines;
+    std::vector<Stmt>        stmts;
+    std::vector<ExprId>      expr_lists;
+    std::vector<StmtId>      stmt_lists;
+    std::vector<Name>        name_lists;
+    std::vector<Coord>       coord_lists;
+    std::vector<Value>       strings;
+    std::vector<FuncBody>    bodies;
+
+    void shift_body_lines(BodyId id, int delta);
+    void shift_expr_lines(ExprId id, int delta);
+
+public:
+    ExprId add(Expr expr, int line);
+    StmtId add(Stmt stmt);
+
+    NodeList<ExprId> add_list(std::span<const ExprId> items);
+    NodeList<StmtId> add_list(std::span<const StmtId> items);
+    NodeList<Name>   add_list(std::span<const Name> items);
+    NodeList<Coord>  add_list(std::span<const Coord> items);
+    StringId         add_string(std::string_view text);
+    BodyId           add_body(FuncBody body);
+
+    [[nodiscard]]
+    const Expr& expr(ExprId id) const;
+    Expr&       expr(ExprId id);
+
+    [[nodiscard]]
+    int line(ExprId id) const;
+
+    [[nodiscard]]
+    const Stmt& stmt(StmtId id) const;
+    Stmt&       stmt(StmtId id);
+
+    [[nodiscard]]
+    std::span<const ExprId> list(NodeList<ExprId> list) const;
+    std::span<ExprId>       list(NodeList<ExprId> list);
+
+    [[nodiscard]]
+    std::span<const StmtId> list(NodeList<StmtId> list) const;
+    std::span<StmtId>       list(NodeList<StmtId> list);
+
+    [[nodiscard]]
+    std::span<const Name> list(NodeList<Name> list) const;
+    std::span<Name>       list(NodeList<Name> list);
+
+    [[nodiscard]]
+    std::span<const Coord> list(NodeList<Coord> list) const;
+
+    [[nodiscard]]
+    const std::string& string(StringId id) const;
+    /* The literal as a value, allocated when it was parsed and shared by every evaluation */
+    [[nodiscard]]
+    const Value& string_value(StringId id) const;
+
+    [[nodiscard]]
+    const FuncBody& body(BodyId id) const;
+
+    /* Number of expression and statement nodes, including ones no longer referenced */
+    [[nodiscard]]
+    size_t size() const;
+
+    /* Moves every line recorded in the subtree by `delta`, used when code above it gained or lost lines */
+    void shift_lines(StmtId id, int delta);
+
+    /* Drops every node but keeps the allocated capacity, for arenas reused as scratch space */
+    void clear();
+};
+
+/**
+ * A parsed program: its top level statements and the arena holding them.
+ */
+struct Program {
+    std::shared_ptr<Ast> ast;
+    std::vector<StmtId>  statements{};
+};
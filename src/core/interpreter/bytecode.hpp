@@ -0,0 +1,96 @@
+#pragma once
+
+#include "interpreter/interpreter.hpp"
+#include "utils/symbol.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Instructions of the register VM. `a`, `b` and `c` name registers of the running frame unless noted,
+ * `bx` is `b` and `c` read together as one 32-bit operand, used for jump targets and table indices.
+ * The binary operators follow the order of BinaryOp.
+ */
+enum class Op : uint8_t {
+    LOADK,         // R[a] = constants[bx]
+    LOADNIL,       // R[a] = nil
+    MOVE,          // R[a] = R[b]
+    ADD,           // R[a] = R[b] + R[c], and so on up to NOT_EQUAL
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    MODULO,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    NEGATE,        // R[a] = -R[b]
+    NOT,           // R[a] = !R[b]
+    JUMP,          // pc = bx
+    JUMP_IF,       // pc = bx when R[a] is truthy
+    JUMP_IF_NOT,   // pc = bx when R[a] is falsy
+    GET_GLOBAL,    // R[a] = global names[bx]
+    SET_GLOBAL,    // global names[bx] = R[a]
+    DEFINE_GLOBAL, // declares global names[bx] as R[a]
+    GET_ENV,       // R[a] = lookups[bx]
+    SET_ENV,       // lookups[bx] = R[a]
+    DEFINE_ENV,    // declares names[bx] in the innermost environment as R[a]
+    DUPLICATE,     // fails the declaration of names[bx], its slot is already declared
+    ENTER,         // pushes an environment of bx slots
+    LEAVE,         // pops `a` environments
+    CLOSURE,       // R[a] = functions[bx], closing over the innermost environment
+    CHECK_CALL,    // fails unless R[a] is a function taking `b` arguments
+    CALL,          // R[a] = R[a](R[a + 1], ..., R[a + b])
+    TAIL_CALL,     // returns R[a](R[a + 1], ..., R[a + b]), the callee takes over the frame
+    RETURN,        // returns R[a]
+};
+
+constexpr size_t OP_COUNT = static_cast<size_t>(Op::RETURN) + 1;
+
+struct Instr {
+    Op       op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+
+    [[nodiscard]]
+    uint32_t bx() const {
+        return b | static_cast<uint32_t>(c) << 16;
+    }
+};
+
+/**
+ * A variable of an environment: the candidate slots to try, counted in environments out from the innermost
+ * one, then the global of that name when none holds a value. See Variable for why there may be several.
+ */
+struct Lookup {
+    std::vector<Coord> coords;
+    Symbol             name;
+};
+
+/* A function or lambda a chunk creates closures of, declared in the chunk's arena */
+struct Prototype {
+    NodeList<Name> params;
+    BodyId         body;
+    Symbol         name;
+    bool           lambda = false;
+};
+
+/**
+ * Bytecode of the top level of a program or of one function body, with the tables its instructions index.
+ * `lines` holds the source line of every instruction, for the errors it reports.
+ */
+struct Chunk {
+    std::vector<Instr>     code;
+    std::vector<int>       lines;
+    std::vector<Value>     constants;
+    std::vector<Name>      names;
+    std::vector<Lookup>    lookups;
+    std::vector<Prototype> functions;
+    /* Arena declaring the functions above, kept by every closure created from them */
+    std::shared_ptr<const Ast> ast;
+    uint32_t                   registers = 0;
+};
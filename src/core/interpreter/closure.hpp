@@ -0,0 +1,83 @@
+#pragma once
+
+#include "interpreter/interpreter.hpp"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Runs programs compiled to a tree of C++ closures, an alternative to walking their syntax tree.
+ *
+ * Every statement and expression is turned once into a closure bound to what it needs: the closures of its
+ * children, its operator, its literal already a Value, the local or environment slots of its variables.
+ * Running code is then calling those closures, no node variant is visited anymore. A frame is an array of
+ * locals, numbered as the Layout numbers registers, plus the value of the body, set by the statement that ends
+ * it. A call in tail position hands its callee to the loop of the running call instead of recursing.
+ *
+ * Globals, native functions, environments and function values are the interpreter's, a function body is
+ * readied by it on its first call then compiled once. Errors are the interpreter's too, on the same lines.
+ */
+class ClosureEngine;
+
+class ClosureEngine {
+public:
+    /* A call running: its locals, its innermost environment and the value of its body */
+    struct Frame {
+        Value*                       locals;
+        std::shared_ptr<Environment> env;
+        Value                        result;
+    };
+
+    using ExprFn = std::function<Value(Frame&)>;
+    using StmtFn = std::function<ExecControl(Frame&)>;
+
+private:
+    class Builder;
+
+    struct Body {
+        StmtFn   code;
+        uint32_t locals   = 0;
+        uint32_t slots    = 0;
+        bool     captured = false;
+        /* First parameter declaring a name an earlier one did, the call fails on it */
+        std::optional<size_t> duplicate;
+    };
+
+    /* Where a frame's locals were taken from, restored when it is released */
+    struct Mark {
+        size_t segment;
+        size_t used;
+    };
+
+    static constexpr size_t SEGMENT_SIZE = 4096;
+
+    Interpreter& interpreter;
+
+    std::unordered_map<const FuncBody*, std::unique_ptr<Body>> bodies;
+
+    /* Locals of the frames running, in segments that never move so frames keep pointers into them */
+    std::vector<std::vector<Value>> segments;
+    size_t                          segment = 0;
+    size_t                          used    = 0;
+
+    /* Call left by a call in tail position, made by the loop of the call it ended */
+    std::shared_ptr<Callable> tail_callee;
+    std::vector<Value>        tail_args;
+
+    /* The closures of a function body, compiled on its first call */
+    const Body& compiled(const Func& func);
+
+    Value* allocate(size_t count, Mark& mark);
+    void   release(Value* locals, size_t count, Mark mark);
+
+public:
+    explicit ClosureEngine(Interpreter& interpreter) : interpreter(interpreter) {}
+
+    void run(const Program& program);
+
+    /* Calls a function, then each function its body ended with a tail call to */
+    Value call(const Func& func, std::vector<Value> arguments);
+};
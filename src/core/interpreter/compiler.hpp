@@ -0,0 +1,95 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+#include "interpreter/bytecode.hpp"
+#include "interpreter/layout.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Compiles resolved code to bytecode for the Vm, one chunk for the top level and one per function body.
+ *
+ * Locals are laid out in registers and environments by a Layout. Temporaries are allocated above the
+ * locals, like a stack, and reserved from the same Layout.
+ *
+ * Statement values only matter at the end of a function body, so only statements in that position are
+ * given a register to leave their value in, following how the interpreter derives the value of a body.
+ */
+class Compiler;
+
+class Compiler {
+    static constexpr uint16_t NO_REG = UINT16_MAX;
+
+    struct Loop {
+        uint32_t              start;
+        uint32_t              environments;
+        std::vector<uint32_t> breaks;
+    };
+
+    /* Where a variable is read and assigned, as a register or an index into the chunk's lookups or names */
+    struct Place {
+        enum { REGISTER, ENVIRONMENT, GLOBAL } kind;
+        uint32_t index;
+    };
+
+    const Ast&        ast;
+    Chunk&            chunk;
+    const bool        function;
+    Layout            layout{.limit = NO_REG};
+    std::vector<Loop> loops;
+    /* Returns of the top level statement being compiled, they end that statement only */
+    std::vector<uint32_t> exits;
+
+    std::unordered_map<uint64_t, uint32_t>         numbers;
+    std::unordered_map<std::string_view, uint32_t> strings;
+
+    Compiler(const Ast& ast, Chunk& chunk, const bool function) : ast(ast), chunk(chunk), function(function) {}
+
+    uint32_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, int line = 0);
+    uint32_t emit_bx(Op op, uint32_t a, uint32_t bx, int line = 0);
+    void     patch(uint32_t jump, uint32_t target);
+    [[nodiscard]]
+    uint32_t here() const;
+
+    uint16_t push();
+    [[nodiscard]]
+    bool is_temporary(uint16_t reg) const;
+
+    uint32_t constant(const Literal& literal);
+    uint32_t name(const Name& name);
+    uint32_t prototype(NodeList<Name> params, BodyId body, Symbol name, bool lambda);
+
+    Place place(Symbol name, std::span<const Coord> coords);
+    void  load(Place place, uint16_t dst);
+    void  store(Place place, uint16_t src);
+
+    void enter(uint32_t slots, bool captured);
+    void leave();
+    void declare(const Name& name, ExprId initializer, const FuncDeclStmt* func, uint16_t dst);
+
+    void statements(std::span<const StmtId> statements, uint16_t dst);
+    void statement(StmtId stmt, uint16_t dst);
+    void loop(const WhileStmt& stmt, uint16_t dst);
+    void jump_out(uint32_t environments_kept);
+
+    void     expr(ExprId expr, uint16_t dst);
+    uint16_t operand(ExprId expr, bool direct);
+    void     assign(const Assign& assign, uint16_t dst);
+    void     call(const Call& call, ExprId expr, uint16_t dst);
+    void     hoisted(const Hoisted& hoisted, uint16_t dst);
+
+    [[nodiscard]]
+    bool assigns(ExprId expr) const;
+
+public:
+    /* Compiles the top level statements of a resolved program */
+    static std::unique_ptr<Chunk> compile(const Program& program);
+
+    /* Compiles a resolved function body, its parameters arrive in the first registers */
+    static std::unique_ptr<Chunk> compile(const ResolvedBody& body, std::span<const Name> params);
+};
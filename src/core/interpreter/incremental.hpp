@@ -0,0 +1,58 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+#include "types/error.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Parses successive versions of one source, reparsing only the top level declarations an edit touched.
+ * Each declaration covers the source from its first token up to the first token of the next one and is
+ * kept with a hash of that text. After an edit the declarations before it are reused as they are,
+ * parsing restarts at the first one whose text or following token changed, and stops again as soon as
+ * it reaches the start of an old declaration lying past the edit, which is reused with the rest of them.
+ */
+class IncrementalParser;
+
+class IncrementalParser {
+    struct Declaration {
+        size_t             begin = 0;
+        size_t             end   = 0;
+        size_t             hash  = 0;
+        int                line  = 1;
+        StmtId             stmt  = StmtId::NONE;
+        size_t             nodes = 0;
+        std::vector<Error> scan_errors{};
+        std::vector<Error> parse_errors{};
+    };
+
+    /* Reparsed declarations are appended, the arena is rebuilt once unreachable nodes outnumber live ones */
+    static constexpr size_t COMPACT_SLACK = 4096;
+
+    std::shared_ptr<Ast>     ast = std::make_shared<Ast>();
+    std::string              text;
+    std::vector<Declaration> declarations;
+    size_t                   live_nodes = 0;
+
+public:
+    struct EditStats {
+        size_t                    reparsed  = 0;
+        size_t                    reused    = 0;
+        bool                      compacted = false;
+        std::chrono::microseconds elapsed{};
+    };
+
+    /* Brings the parse up to date with the new version of the source */
+    EditStats update(std::string_view source);
+
+    [[nodiscard]]
+    Program program() const;
+
+    /* Scanner errors when there are any, parser errors otherwise, like a full parse reports them */
+    [[nodiscard]]
+    std::vector<Error> collected_errors() const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+#include "utils/symbol.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Substitutes the bodies of small top level functions at their call sites, sparing the call its environment,
+ * argument vector and block execution. A function is inlined when its body is a single expression, or the
+ * return of one, of at most `limit` nodes, declaring nothing, assigning nothing, creating no closure and not
+ * calling itself. Its parameters must be distinct, a duplicate one fails at every call.
+ *
+ * Runs on resolved code, a call is only inlined when its callee resolved to a global. Whether that global
+ * still holds the inlined function is checked on every evaluation, see Inline, so a reassigned function
+ * is called as usual. Functions of every program run by the interpreter stay candidates, for the REPL.
+ */
+class Inliner;
+
+class Inliner {
+    enum class State : uint8_t {
+        UNCHECKED,
+        INLINABLE,
+        REJECTED,
+    };
+
+    struct Target {
+        /* Arena declaring the function, kept alive so the identity checked by matches stays unique */
+        std::shared_ptr<const Ast> ast;
+        NodeList<Name>             params;
+        BodyId                     body;
+        Symbol                     name;
+        State                      state = State::UNCHECKED;
+        /* Arena holding the body statements and the expression substituted, NONE for an empty body */
+        const Ast* code = nullptr;
+        ExprId     expr = ExprId::NONE;
+    };
+
+    size_t                               limit;
+    std::vector<Target>                  targets;
+    std::unordered_map<Symbol, uint32_t> by_name;
+
+    Ast*                  ast = nullptr;
+    std::vector<uint32_t> inlining;
+    size_t                inlined = 0;
+
+    bool   inlinable(Target& target);
+    bool   is_small(const Target& target, const Ast& code, ExprId expr, size_t& nodes) const;
+    void   rewrite(std::span<const StmtId> statements);
+    void   rewrite(StmtId stmt);
+    void   rewrite(BodyId body);
+    ExprId rewrite(ExprId expr);
+    ExprId substitute(ExprId call);
+    ExprId copy(const Target& target, ExprId expr, bool tail);
+
+public:
+    static constexpr size_t DEFAULT_LIMIT = 16;
+
+    explicit Inliner(const size_t limit = DEFAULT_LIMIT) : limit(limit) {}
+
+    /* Registers the top level functions of a resolved program and inlines its calls, returns how many */
+    size_t inline_calls(const Program& program);
+
+    /* Inlines the calls of a deferred body once it is parsed and resolved */
+    void inline_calls(Ast& code, std::span<const StmtId> statements);
+
+    /* Whether a function, given by its arena and body, is the one an Inline node substituted */
+    [[nodiscard]]
+    bool matches(uint32_t target, const Ast* code, BodyId body) const;
+};
@@ -1,8 +1,13 @@
 #pragma once
 
+#include "inliner.hpp"
 #include "parser.hpp"
+#include "utils/symbol.hpp"
+#include "value.hpp"
 
 #include <functional>
+#include <optional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -10,7 +15,6 @@
 struct Callable;
 struct Func;
 struct NativeFunc;
-using Value = std::variant<std::nullptr_t, double, std::string, bool, std::shared_ptr<Callable>>;
 
 struct ExecSig;
 enum class ExecControl {
@@ -24,88 +28,189 @@ struct ExecSig {
     Value       value;
 };
 
+/**
+ * Globals are kept by symbol in the global environment, every other environment is a flat array
+ * of the slots the resolver laid out for its scope. A slot stays empty until its declaration runs.
+ * Only scopes a closure captures get an Environment, the others are frames on the interpreter's stack.
+ */
 class Environment;
 class Environment {
-    std::unordered_map<std::string, Value> variables;
-    std::shared_ptr<Environment>           enclosing = nullptr;
+    std::unordered_map<Symbol, Value> variables;
+    std::vector<std::optional<Value>> slots;
+    std::shared_ptr<Environment>      enclosing = nullptr;
 
 public:
     Environment() = default;
-    explicit Environment(const std::shared_ptr<Environment>& enclosing) : enclosing(enclosing) {}
+    Environment(const std::shared_ptr<Environment>& enclosing, const size_t size) : slots(size), enclosing(enclosing) {}
     ~Environment() = default;
 
-    bool  contains(const std::string& name) const;
-    void  define(const std::string& name, const Value& value);
-    void  define(const Token& name, const Value& value);
-    Value get(std::string name);
-    void  assign(std::string name, const Value& value);
-    void  remove(const std::string& name);
+    bool  contains(Symbol name) const;
+    void  define(Symbol name, const Value& value);
+    void  define(const Name& name, const Value& value);
+    Value get(Symbol name);
+    void  assign(Symbol name, const Value& value);
+    void  remove(Symbol name);
+
+    /* The value of a name this environment itself declares, null when it has none */
+    Value* find(Symbol name);
+
+    /* The slot at a coordinate, empty or not */
+    std::optional<Value>& at(Coord coord);
+
+    [[nodiscard]]
+    const std::shared_ptr<Environment>& parent() const;
+
+    /* Declares a name into a slot, wherever the slot is, failing when it is already declared */
+    static void define(std::optional<Value>& slot, const Name& name, const Value& value);
+};
+
+/* A function body ready to run: its arena, its statements, the size of its call scope and whether it is captured */
+struct ResolvedBody {
+    const Ast&              ast;
+    std::span<const StmtId> statements;
+    uint32_t                slots    = 0;
+    bool                    captured = false;
 };
 
+class Jit;
+
 class Interpreter;
 class Interpreter {
     std::shared_ptr<Environment> global_env = std::make_shared<Environment>();
     std::shared_ptr<Environment> env        = global_env;
+    /* Arena of the code being executed, switched when calling into a function of another program */
+    const Ast* ast = nullptr;
 
-    static void panic(int err_code, const std::string& message, int line);
-
-    /*
-     false and nil is falsy, everything else is truthy
+    /**
+     * Slots of the scopes no closure captures, frames pushed when a scope is entered and popped on its exit.
+     * `frames` holds where each frame starts. The last `in_scope` frames are the innermost scopes of the code
+     * being executed, `env` encloses them: a captured scope never sits inside one that is not.
      */
-    static bool is_truthy(const Value& value);
+    std::vector<std::optional<Value>> stack;
+    std::vector<uint32_t>             frames;
+    uint32_t                          in_scope = 0;
 
-    /*
-     Check if two values are equal
-     */
-    static bool is_equal(const Value& left, const Value& right);
+    Inliner inliner;
+    /* Arguments of the inlined calls being evaluated, the innermost one starts at inline_base */
+    std::vector<Value> inline_args;
+    size_t             inline_base = 0;
+
+    /* Call left by a call in tail position, made by the trampoline of the function it ended, see call */
+    std::shared_ptr<Callable> tail_callee;
+    std::vector<Value>        tail_args;
+
+    /* Compiles hot numeric functions to machine code when set, see Jit */
+    Jit* jit = nullptr;
+
+    static void panic(int err_code, const std::string& message, int line);
 
     /*
      Ensure that the operand is a number (double)
      */
-    static void ensure_num_operands(const Token& op, const std::vector<Value>& operands);
+    static void ensure_num_operands(int line, const Value& operand);
+    static void ensure_num_operands(int line, const Value& left, const Value& right);
     static bool is_num_operand(const Value& operand);
 
-    ExecSig run(const Stmt& stmt);
+    /* The specialized form of a binary operator for the operands it was first evaluated with */
+    static Specialization specialize(BinaryOp op, const Value& left, const Value& right);
+
+    ExecSig run(StmtId stmt);
     ExecSig runExprStmt(const ExprStmt& stmt);
     ExecSig runIfStmt(const IfStmt& stmt);
     ExecSig runVarDeclStmt(const VarDeclStmt& stmt);
     ExecSig runFuncDeclStmt(const FuncDeclStmt& stmt);
     ExecSig runBlockStmt(const BlockStmt& stmt);
     ExecSig runWhileStmt(const WhileStmt& stmt);
+    ExecSig runLoop(const WhileStmt& stmt);
     ExecSig runReturnStmt(const ReturnStmt& stmt);
 
     static ExecSig runBreakStmt();
     static ExecSig runContinueStmt();
 
-    static Value evaluateLiteralExpr(const Literal& literal);
+    [[nodiscard]]
+    Value evaluateLiteralExpr(const Literal& literal) const;
 
     [[nodiscard]]
-    Value evaluateVariableExpr(const Variable& variable) const;
+    Value evaluateVariableExpr(const Variable& variable);
 
-    Value evaluate(const std::shared_ptr<Expr>& expr);
-    Value evaluateBinaryExpr(const Binary& binary);
+    Value evaluate(ExprId expr);
+    Value evaluateBinaryExpr(const Binary& binary, ExprId expr);
     Value evaluateGroupingExpr(const Grouping& group);
-    Value evaluateUnaryExpr(const Unary& unary);
+    Value evaluateUnaryExpr(const Unary& unary, ExprId expr);
     Value evaluateAssignExpr(const Assign& assign);
     Value evaluateLogicalExpr(const Logical& logical);
-    Value evaluateCallExpr(const Call& call);
+    Value evaluateCallExpr(const Call& call, ExprId expr);
 
     [[nodiscard]]
     Value evaluateLambdaExpr(const Lambda& lambda) const;
 
+    Value evaluateInlineExpr(const Inline& inlined);
+    Value evaluateHoistedExpr(const Hoisted& hoisted);
+
+    ExecSig executeBlock(std::span<const StmtId> statements, const std::shared_ptr<Environment>& environment);
+    ExecSig executeFrame(std::span<const StmtId> statements, uint32_t slots);
+    ExecSig execute(std::span<const StmtId> statements);
+
+    void                  push_frame(uint32_t slots);
+    void                  pop_frame();
+    std::optional<Value>& slot(Coord coord);
+    void                  define(const Name& name, const Value& value);
+
+    /* The first of the candidate slots holding a value, null when the name is left to the globals */
+    Value* find(std::span<const Coord> coords);
+
     void prelude() const;
 
 public:
-    Interpreter() {
+    explicit Interpreter(const size_t inline_limit = Inliner::DEFAULT_LIMIT) : inliner(inline_limit) {
         prelude();
     }
     ~Interpreter() = default;
 
-    ExecSig
-    executeBlock(const std::vector<std::shared_ptr<Stmt>>& statements, const std::shared_ptr<Environment>& environment);
+    /* Globals and native functions, shared with the VM */
+    [[nodiscard]]
+    const std::shared_ptr<Environment>& globals() const;
+
+    /* Makes the calls to functions the JIT compiled in machine code, it must outlive the interpreter's calls */
+    void use_jit(Jit* jit);
+
+    /* Inlines the calls of a resolved program to small top level functions, returns how many */
+    size_t inline_calls(const Program& program);
 
-    ExecSig interpret(const std::vector<Stmt>& statements);
+    /* Readies a function body for its call, a deferred one is parsed, optimized, resolved and inlined first */
+    ResolvedBody function_body(const Ast& code, BodyId id);
+
+    /**
+     * Calls a function, then each function its body ended with a tail call to, in this same C++ frame.
+     * The environment of a call is released before the next one is made, unless a closure captured it.
+     */
+    ExecSig call(const Func& func, std::vector<Value> arguments);
+
+    /* Runs statements of the given arena, used to enter function bodies */
+    ExecSig executeBlock(
+        const Ast&                          code,
+        std::span<const StmtId>             statements,
+        const std::shared_ptr<Environment>& environment);
+
+    ExecSig interpret(const Program& program);
     void    exclude_native_func(const std::vector<std::string>& list) const;
+
+    /*
+     false and nil is falsy, everything else is truthy
+     */
+    static bool is_truthy(const Value& value);
+
+    /*
+     Check if two values are equal
+     */
+    static bool is_equal(const Value& left, const Value& right);
+
+    /*
+     Apply an operator to evaluated operands, an invalid operand is reported on the given line.
+     Shared with the optimizer, which folds constant operations with the exact runtime semantics.
+     */
+    static Value binary(BinaryOp op, const Value& left, const Value& right, int line);
+    static Value unary(UnaryOp op, const Value& right, int line);
 };
 
 struct Callable {
@@ -121,43 +226,42 @@ struct Callable {
 };
 
 struct Func : Callable {
-    const std::vector<Token>                 params;
-    const std::vector<std::shared_ptr<Stmt>> body;
-    const std::shared_ptr<Environment>       closure;
-    const std::string                        name;
+    /* Keeps the arena holding the body alive for as long as the function can be called */
+    const std::shared_ptr<const Ast>   ast;
+    const NodeList<Name>               params;
+    const BodyId                       body;
+    const std::shared_ptr<Environment> closure;
+    const Symbol                       name;
 
     // using constructor to perform move semantics
     Func(
-        std::vector<Token>                 params,
-        std::vector<std::shared_ptr<Stmt>> body,
-        std::shared_ptr<Environment>       closure,
-        std::string                        name)
-        : params(std::move(params)), body(std::move(body)), closure(std::move(closure)), name(std::move(name)) {}
+        std::shared_ptr<const Ast>   ast,
+        const NodeList<Name>         params,
+        const BodyId                 body,
+        std::shared_ptr<Environment> closure,
+        const Symbol                 name)
+        : ast(std::move(ast)), params(params), body(body), closure(std::move(closure)), name(name) {}
 
     ExecSig call(Interpreter& interpreter, const std::vector<Value>& arguments) const override {
-        const auto function_env = std::make_shared<Environment>(closure);
-        for(size_t i = 0; i < params.size(); ++i) {
-            function_env->define(params[i], arguments[i]);
-        }
-        return interpreter.executeBlock(body, function_env);
+        return interpreter.call(*this, arguments);
     }
 
     [[nodiscard]] size_t arity() const override {
-        return params.size();
+        return params.size;
     }
 
     [[nodiscard]] std::string to_string() const override {
-        return "<function " + name + ">";
+        return "<function " + std::string(name.name()) + ">";
     }
 };
 
 struct LambdaFunc final : Func {
-    const std::vector<Token>                 params;
-    const std::vector<std::shared_ptr<Stmt>> body;
-    const std::shared_ptr<Environment>       closure;
-
-    LambdaFunc(std::vector<Token> params, std::vector<std::shared_ptr<Stmt>> body, std::shared_ptr<Environment> closure)
-        : Func(std::move(params), std::move(body), std::move(closure), "lambda") {}
+    LambdaFunc(
+        std::shared_ptr<const Ast>   ast,
+        const NodeList<Name>         params,
+        const BodyId                 body,
+        std::shared_ptr<Environment> closure)
+        : Func(std::move(ast), params, body, std::move(closure), Symbol::intern("lambda")) {}
 };
 
 struct NativeFunc final : Callable {
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "interpreter/interpreter.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Baseline JIT of the tree-walker, compiling hot numeric functions to x86-64 machine code.
+ *
+ * Calls are counted per function body, one called `threshold` times is compiled when its body only uses
+ * numbers, its own locals, arithmetic, comparisons as conditions, `if`, `while` and calls to global functions.
+ * Each construct is emitted from a fixed template working on doubles in the machine frame, no register
+ * allocation is done. Other functions are left to the interpreter.
+ *
+ * Compiled code has no effect but its result: it only writes its locals and calls compiled functions. When it
+ * meets anything else, a non-number argument, a callee that is not compiled or too deep a recursion, it bails
+ * out and the interpreter makes the whole call again. A function bailing out too often is deoptimized for good.
+ * Only x86-64 Unix systems get machine code, elsewhere every function is left to the interpreter.
+ */
+class Jit;
+
+class Jit {
+public:
+    /* Native code of a function: arguments in, result out, returns 0 or 1 when it bailed out */
+    using Entry = int (*)(const double* args, double* result, Jit* jit);
+
+    static constexpr uint32_t DEFAULT_THRESHOLD = 64;
+    /* Bailouts after which a compiled function goes back to the interpreter for good */
+    static constexpr uint32_t MAX_BAILOUTS = 16;
+    /* Nested calls of compiled code, deeper ones bail out before the native stack runs out */
+    static constexpr uint32_t MAX_DEPTH = 10000;
+
+    struct Stats {
+        size_t compiled    = 0;
+        size_t bailouts    = 0;
+        size_t deoptimized = 0;
+    };
+
+private:
+    enum class State : uint8_t {
+        COUNTING,
+        COMPILED,
+        REJECTED,
+    };
+
+    struct Function {
+        State    state    = State::COUNTING;
+        uint32_t calls    = 0;
+        uint32_t bailouts = 0;
+        Entry    entry    = nullptr;
+    };
+
+    /* A call made by compiled code, to the global `name`, with the callee it found last time */
+    struct Site {
+        Symbol                    name;
+        uint32_t                  argc;
+        const Value*              global   = nullptr;
+        std::shared_ptr<Callable> callee   = nullptr;
+        Function*                 function = nullptr;
+    };
+
+    /* Executable mapping holding the code of one function */
+    struct Code {
+        void*  memory;
+        size_t size;
+    };
+
+    Interpreter&   interpreter;
+    const uint32_t threshold;
+
+    std::unordered_map<const FuncBody*, Function> functions;
+    std::vector<Site>                             sites;
+    std::vector<Code>                             code;
+    std::vector<double>                           arguments;
+    uint32_t                                      depth = 0;
+    Stats                                         stats;
+
+    Function& function(const Func& func);
+    void      compile(const Func& func, Function& function);
+    void      bail(Function& function);
+
+    /* Called by compiled code for each call it makes */
+    static int call_site(Jit* jit, uint32_t site, const double* args, double* result) noexcept;
+
+public:
+    explicit Jit(Interpreter& interpreter, const uint32_t threshold = DEFAULT_THRESHOLD)
+        : interpreter(interpreter), threshold(threshold) {}
+    ~Jit();
+
+    Jit(const Jit&)            = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    /* Counts a call, then makes it in machine code when the function is compiled, empty when it is not or bailed out */
+    std::optional<double> call(const Func& func, std::span<const Value> args);
+
+    [[nodiscard]]
+    Stats statistics() const;
+
+    /* Whether this build emits machine code at all */
+    static bool supported();
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/**
+ * Where the locals of a resolved function live while it runs, shared by the engines compiling it.
+ *
+ * Locals of scopes no closure captures get registers of the frame, numbered like a stack as scopes are
+ * entered and left. Whether such a slot is declared is known at every point of its own function, its
+ * declaration ran if it came earlier in its scope, so each reference is bound to the register of the first
+ * candidate declared by then. Captured scopes keep their heap environments, references into them and into
+ * enclosing functions are looked up when they run, as the interpreter does.
+ */
+struct Layout;
+
+struct Layout {
+    /* A scope of the function being compiled, a captured one has an environment instead of registers */
+    struct Block {
+        bool     captured  = false;
+        uint32_t base      = 0;
+        uint32_t registers = 0;
+        /* Slots whose declaration ran by the point being compiled */
+        std::vector<bool> declared{};
+        /* Value and computed flag of each hoisted expression, for the scope of a loop */
+        uint32_t hoisted = 0;
+        /* First free register when the scope was entered */
+        uint32_t saved = 0;
+    };
+
+    /* Where a variable is read and assigned, `coords` count environments out for ENVIRONMENT */
+    struct Place {
+        enum { REGISTER, ENVIRONMENT, GLOBAL } kind;
+        uint32_t           index = 0;
+        std::vector<Coord> coords{};
+    };
+
+    /* Registers past this one fail the compilation */
+    const uint32_t     limit = UINT32_MAX;
+    std::vector<Block> blocks{};
+    /* First free register, and the most registers in use at once */
+    uint32_t top  = 0;
+    uint32_t size = 0;
+
+    void reserve(uint32_t count);
+
+    /* Environments entered by the code compiled, between it and the scope `depth` out */
+    [[nodiscard]]
+    uint32_t environments(uint32_t depth) const;
+    [[nodiscard]]
+    uint32_t environments() const;
+
+    [[nodiscard]]
+    Place place(std::span<const Coord> coords) const;
+
+    /* Enters the scope of a call, its parameters declared in order. Returns the first one redeclaring a name */
+    std::optional<size_t> call(uint32_t slots, bool captured, std::span<const Name> params);
+    void                  enter(uint32_t slots, bool captured);
+    /* Enters the scope of a loop hoisting `hoisted` expressions, its flags start at `blocks.back().hoisted` */
+    void enter_loop(uint32_t hoisted, bool captured);
+    void leave();
+
+    /* Register of the value of a hoisted expression, its computed flag is the next one */
+    [[nodiscard]]
+    uint32_t hoisted(Coord coord) const;
+};
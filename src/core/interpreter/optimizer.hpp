@@ -0,0 +1,105 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+#include "utils/symbol.hpp"
+
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/* A subtree the optimizer replaced, printed as source by --dump-opt */
+struct Rewrite {
+    int         line = 0;
+    std::string before;
+    std::string after;
+};
+
+/* What the optimizer did to a program, collected for --dump-opt */
+struct OptimizeReport {
+    std::vector<Rewrite> folded;
+    /* Statement and expression nodes no longer reachable once dead code was eliminated */
+    size_t removed = 0;
+    /* Loop invariants, `after` is the name they are kept under */
+    std::vector<Rewrite> hoisted;
+};
+
+/**
+ * Rewrites a parsed program before it is resolved and run, in three passes.
+ *
+ * Folding: binary, unary, grouping and logical expressions over literals are folded into a literal,
+ * computed with the interpreter's own operators so the result is exactly what evaluating them would
+ * give. Operations that would fail are kept for the runtime to report. A logical expression with a
+ * literal on its left is reduced to the operand it always yields.
+ *
+ * Elimination: an if with a literal condition is replaced by the branch it takes, a while with a falsy
+ * literal condition is dropped, so are statements of a block following one that always returns, breaks
+ * or continues, and statements whose evaluation has no effect. The last statement of a block is its value,
+ * it is kept. Top level statements all run even after a return, only the untaken branches are dropped there.
+ *
+ * Hoisting: in a loop that calls nothing, operations over literals and variables neither assigned nor declared
+ * in the loop are invariant. Each is computed once per entry into the loop, the first time it is needed, so it
+ * still fails where and when it would have, and not at all in a loop that never runs it.
+ */
+class Optimizer;
+
+class Optimizer {
+    Ast&            ast;
+    OptimizeReport* report;
+
+    /* Invariants hoisted out of the loop being rewritten, and how many were hoisted so far, naming the next */
+    std::vector<Name> hoisting;
+    uint32_t          hoisted = 0;
+
+    Optimizer(Ast& ast, OptimizeReport* report) : ast(ast), report(report) {}
+
+    void   fold(std::span<const StmtId> statements);
+    void   fold(StmtId stmt);
+    void   fold(BodyId body);
+    ExprId fold(ExprId expr);
+    ExprId fold_node(ExprId expr);
+
+    void eliminate(NodeList<StmtId>& statements);
+    void eliminate(StmtId stmt);
+    void eliminate(BodyId body);
+    void eliminate(ExprId expr);
+
+    void   hoist(std::span<const StmtId> statements);
+    void   hoist(StmtId stmt);
+    void   hoist(BodyId body);
+    void   hoist(ExprId expr);
+    void   hoist(StmtId stmt, const std::unordered_set<Symbol>& variant);
+    ExprId hoist(ExprId expr, const std::unordered_set<Symbol>& variant);
+
+    /* Collects the names a loop assigns or declares, returns whether it makes a call that could change others */
+    bool writes(StmtId stmt, std::unordered_set<Symbol>& names) const;
+    bool writes(ExprId expr, std::unordered_set<Symbol>& names) const;
+
+    [[nodiscard]]
+    bool is_invariant(ExprId expr, const std::unordered_set<Symbol>& variant) const;
+
+    [[nodiscard]]
+    bool is_inert(StmtId stmt) const;
+
+    [[nodiscard]]
+    bool is_pure(ExprId expr) const;
+
+    [[nodiscard]]
+    bool terminates(StmtId stmt) const;
+
+    [[nodiscard]]
+    size_t count(StmtId stmt) const;
+
+    [[nodiscard]]
+    size_t count(ExprId expr) const;
+
+    [[nodiscard]]
+    size_t count(BodyId body) const;
+
+public:
+    /* Rewrites every statement reachable without parsing a deferred body, reporting what it did when asked */
+    static void optimize(const Program& program, OptimizeReport* report = nullptr);
+
+    /* Rewrites a deferred body once it is parsed */
+    static void optimize(Ast& ast, NodeList<StmtId>& statements);
+};
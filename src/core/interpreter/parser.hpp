@@ -1,126 +1,77 @@
 #pragma once
 
+#include "interpreter/ast.hpp"
 #include "types/error.hpp"
 #include "types/token_t.hpp"
+#include "utils/symbol.hpp"
 
+#include <array>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 #include <variant>
 #include <tuple>
 #include <string>
-
-struct ExprStmt;
-struct IfStmt;
-struct VarDeclStmt;
-struct FuncDeclStmt;
-struct BlockStmt;
-struct WhileStmt;
-struct BreakStmt;
-struct ContinueStmt;
-struct ReturnStmt;
-
-using Stmt = std::
-    variant<ExprStmt, IfStmt, VarDeclStmt, FuncDeclStmt, BlockStmt, WhileStmt, BreakStmt, ContinueStmt, ReturnStmt>;
-
-struct Binary;
-struct Unary;
-struct Grouping;
-struct Variable;
-struct Assign;
-struct Logical;
-struct Call;
-struct Lambda;
-using Literal = std::variant<std::nullptr_t, double, std::string, bool>;
-
-using Expr = std::variant<Binary, Grouping, Unary, Literal, Variable, Assign, Logical, Call, Lambda>;
+#include <string_view>
 
 struct Token;
 struct Token {
-    TokenType   type;
-    std::string lexeme;
-    Literal     literal;
-    int         line;
-};
-
-using ScanResult  = std::tuple<std::vector<Token>, std::vector<Error>>;
-using ParseResult = std::tuple<std::vector<Stmt>, std::vector<Error>>;
-
-struct ExprStmt {
-    std::shared_ptr<Expr> expr;
-};
-
-struct IfStmt {
-    std::shared_ptr<Expr> condition;
-    std::shared_ptr<Stmt> then_branch;
-    std::shared_ptr<Stmt> else_branch;
-};
-
-struct VarDeclStmt {
-    Token                 name;
-    std::shared_ptr<Expr> initializer;
-};
-
-struct FuncDeclStmt {
-    Token                              name;
-    std::vector<Token>                 params;
-    std::vector<std::shared_ptr<Stmt>> body;
-};
-
-struct BlockStmt {
-    std::vector<std::shared_ptr<Stmt>> statements;
+    TokenType type;
+    /* View into the source buffer the token was scanned from */
+    std::string_view lexeme;
+    Literal          literal;
+    int              line;
+    /* Interned name of IDENTIFIER tokens */
+    Symbol symbol{};
 };
 
-struct WhileStmt {
-    std::shared_ptr<Expr> condition;
-    std::shared_ptr<Stmt> body;
-};
-
-struct BreakStmt {};
-struct ContinueStmt {};
-
-struct ReturnStmt {
-    std::shared_ptr<Expr> value;
-};
+/**
+ * Source of tokens pulled by the parser one at a time.
+ * Once the source is exhausted it keeps returning the END token.
+ */
+class TokenSource;
 
-struct Binary {
-    std::shared_ptr<Expr> left;
-    Token                 op;
-    std::shared_ptr<Expr> right;
-};
+class TokenSource {
+public:
+    virtual ~TokenSource() = default;
 
-struct Unary {
-    Token                 op;
-    std::shared_ptr<Expr> right;
+    virtual Token next_token() = 0;
 };
 
-struct Grouping {
-    std::shared_ptr<Expr> expr;
-};
+/**
+ * Token source over an already materialized list of tokens.
+ */
+class TokenList;
 
-struct Variable {
-    Token name;
-};
+class TokenList final : public TokenSource {
+    std::vector<Token> tokens;
+    size_t             next = 0;
 
-struct Assign {
-    Token                 name;
-    std::shared_ptr<Expr> value;
-};
+public:
+    explicit TokenList(std::vector<Token> tokens) : tokens(std::move(tokens)) {}
 
-struct Logical {
-    std::shared_ptr<Expr> left;
-    Token                 op;
-    std::shared_ptr<Expr> right;
+    Token next_token() override;
 };
 
-struct Call {
-    std::shared_ptr<Expr>              callee;
-    Token                              paren;
-    std::vector<std::shared_ptr<Expr>> args;
-};
+using ScanResult  = std::tuple<std::vector<Token>, std::vector<Error>>;
+using ParseResult = std::tuple<Program, std::vector<Error>>;
 
-struct Lambda {
-    std::vector<Token>                 params;
-    std::vector<std::shared_ptr<Stmt>> body;
+/**
+ * Binding power of the expression operators, from the loosest to the tightest
+ */
+enum class Precedence : uint8_t {
+    NONE,
+    ASSIGNMENT,
+    OR,
+    AND,
+    EQUALITY,
+    COMPARISON,
+    TERM,
+    FACTOR,
+    UNARY,
+    CALL,
 };
 
 /**
@@ -129,14 +80,39 @@ struct Lambda {
 class Parser;
 
 class Parser {
-    std::vector<Token> tokens;
-    std::vector<Error> errors;
+    /* Size of the lookahead window, a power of two. The parser needs the current and previous tokens */
+    static constexpr int WINDOW = 4;
+
+    std::unique_ptr<TokenSource> owned_source;
+    TokenSource*                 source = nullptr;
+    std::shared_ptr<Ast>         ast    = std::make_shared<Ast>();
+    std::vector<Error>           errors;
+
+    /**
+     * Text the tokens are views into when function bodies are deferred, empty when they are parsed eagerly.
+     * Deferred bodies are validated into the scratch arena, which is emptied after each of them.
+     */
+    std::string_view     deferred_source;
+    std::shared_ptr<Ast> scratch;
+
+    /* Set when reparsing a deferred body, its warnings were already printed while validating it */
+    bool quiet = false;
+
+    /**
+     * Ring buffer over the last pulled tokens, token k lives at window[k % WINDOW]
+     */
+    std::array<Token, WINDOW> window;
 
     /**
      * Current processing token index
      */
     int i = 0;
 
+    /**
+     * Number of tokens pulled from the source so far
+     */
+    int pulled = 0;
+
     /**
      * Tracking the depth of the loop
      */
@@ -146,53 +122,74 @@ class Parser {
 
     static void panic(int err_code, const std::string& message, int line);
 
-    Token advance();
-    bool  check(TokenType type);
-    bool  match(TokenType type);
-    bool  matches(std::vector<TokenType> types);
-
-    Token current();
-    Token previous();
-    Token consume(TokenType type, int err_code, const std::string& message);
-    bool  is_end();
-    void  synchronize();
-
-    std::vector<Stmt> program();
-
-    Stmt declaration();
-    Stmt var_declaration();
-    Stmt func_declaration();
-    Stmt statement();
-    Stmt if_stmt();
-    Stmt expr_stmt();
-    Stmt block_stmt();
-    Stmt while_stmt();
-    Stmt for_stmt();
-    Stmt break_stmt();
-    Stmt continue_stmt();
-    Stmt return_stmt();
-
-    Expr expression();
-    Expr assignment();
-    Expr logical_or();
-    Expr logical_and();
-    Expr equality();
-    Expr comparison();
-    Expr term();
-    Expr factor();
-    Expr unary();
-    Expr call();
+    const Token& advance();
+    bool         check(TokenType type);
+    bool         match(TokenType type);
+
+    /* Returned references stay valid until the parser advances WINDOW - 2 more tokens */
+    const Token& current();
+    const Token& previous();
+    const Token& consume(TokenType type, int err_code, const std::string& message);
+    void         synchronize();
+
+    std::vector<StmtId> program();
+
+    StmtId declaration();
+    StmtId var_declaration();
+    StmtId func_declaration();
+    StmtId statement();
+    StmtId if_stmt();
+    StmtId expr_stmt();
+    StmtId block_stmt();
+    StmtId while_stmt();
+    StmtId for_stmt();
+    StmtId break_stmt();
+    StmtId continue_stmt();
+    StmtId return_stmt();
+    /* Statements of a block whose '{' was already consumed */
+    NodeList<StmtId> block();
+    /* Body of a function or lambda whose '{' was already consumed */
+    BodyId function_body();
+    void   warn(const Error& warning) const;
+
+    ExprId expression();
+    /* Parses operators binding at least as tightly as `min`, driven by the infix table in parser.cpp */
+    ExprId parse_precedence(Precedence min);
+    ExprId assignment(ExprId target);
+    ExprId unary();
     /* Collect arguments for the function call and create Call expression */
-    Expr arguments(std::shared_ptr<Expr> callee);
-    Expr primary();
-    Expr lambda();
+    ExprId arguments(ExprId callee);
+    ExprId primary();
+    ExprId lambda();
 
 public:
-    ~Parser() = default;
-    static Parser from_tokens(const std::vector<Token>& tokens);
+    Parser(Parser&&) = default;
+    ~Parser()        = default;
+    static Parser from_tokens(std::vector<Token> tokens);
+    /* Pulls tokens from the source on demand, the source must outlive the parser */
+    static Parser from_source(TokenSource& source);
+    /* Appends the parsed nodes to an existing arena */
+    static Parser from_source(TokenSource& source, std::shared_ptr<Ast> ast);
+
+    /**
+     * Only validate function and lambda bodies, parsing each from `source` on its first call instead.
+     * The tokens must be views into `source`, which has to outlive the program.
+     */
+    void defer_bodies(std::string_view source);
+
+    /* Arena and statements of a function body, the body is parsed first if it was deferred */
+    static std::pair<const Ast*, std::span<const StmtId>> function_body(const Ast& ast, BodyId id);
 
     ParseResult parse();
 
+    /* Parses a single top level declaration, for callers tracking the declarations of a program themselves */
+    StmtId       next_declaration();
+    const Token& peek();
+    bool         is_end();
+
     [[nodiscard]]
     bool success() const;
+
+    [[nodiscard]]
+    const std::vector<Error>& collected_errors() const;
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "interpreter/ast.hpp"
+#include "utils/symbol.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Static layout of one block or function environment: the slot of every name declared directly in it.
+ * A scope is captured once a closure is created in it or in a scope it encloses, the closure keeps it alive.
+ */
+struct Scope {
+    std::unordered_map<Symbol, uint32_t> slots{};
+    std::shared_ptr<Scope>               parent{};
+    bool                                 captured = false;
+};
+
+/**
+ * Binds every local variable of a parsed program to slots of its scope, so that the interpreter reaches
+ * locals by index instead of hashing names along the environment chain. Top level names stay global and
+ * are looked up by symbol, later REPL lines and functions declared further down still see them.
+ * Scopes no closure captures are marked for the interpreter to lay out on its stack rather than the heap.
+ * Calls in tail position of a function body, returned or its last expression, are marked for the interpreter
+ * to make in place of the call they end.
+ * Deferred bodies keep the scope they were declared in and are resolved once parsed, on their first call.
+ */
+class Resolver;
+
+class Resolver {
+    Ast&                   ast;
+    std::shared_ptr<Scope> scope;
+    std::vector<Coord>     found;
+
+    explicit Resolver(Ast& ast) : ast(ast) {}
+
+    void declare(Name& name) const;
+    void collect(StmtId stmt);
+    void scoped(std::span<const StmtId> statements);
+    void function(NodeList<Name> params, BodyId body);
+    void body(const FuncBody& body);
+    void tail(StmtId stmt, bool last);
+    void tail(ExprId expr);
+
+    void resolve(StmtId stmt);
+    void resolve(ExprId expr);
+
+    NodeList<Coord> coords(Symbol name);
+
+    /* Slot of a name the optimizer introduced, declared once and always in scope where it is used */
+    [[nodiscard]]
+    Coord coord(Symbol name) const;
+
+public:
+    static void resolve(const Program& program);
+
+    /* Resolves a deferred body once it is parsed into its own arena, in the scope it was declared in */
+    static void resolve(const FuncBody& body);
+};
@@ -5,39 +5,46 @@
 #include "types/error.hpp"
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 /**
- * Tokenizes the source code into a list of tokens.
+ * Tokenizes the source code, either on demand one token at a time or into a list of tokens.
  */
 class Scanner;
 
-class Scanner {
-    std::string        source;
-    std::vector<Token> tokens;
-    std::vector<Error> errors;
-
-    std::unordered_map<std::string, TokenType> keywords = {
-        {keyword::And, TokenType::AND},
-        {keyword::Or, TokenType::OR},
-        {keyword::If, TokenType::IF},
-        {keyword::Else, TokenType::ELSE},
-        {keyword::True, TokenType::TRUE},
-        {keyword::False, TokenType::FALSE},
-        {keyword::Class, TokenType::CLASS},
-        {keyword::This, TokenType::THIS},
-        {keyword::Super, TokenType::SUPER},
-        {keyword::Fun, TokenType::FUN},
-        {keyword::Var, TokenType::VAR},
-        {keyword::For, TokenType::FOR},
-        {keyword::While, TokenType::WHILE},
-        {keyword::Break, TokenType::BREAK},
-        {keyword::Continue, TokenType::CONTINUE},
-        {keyword::Return, TokenType::RETURN},
-        {keyword::Nil, TokenType::NIL},
+class Scanner final : public TokenSource {
+    /* Lines are kept apart from the message until the errors are reported,
+     * a chunk scanned in parallel only learns its first line once the chunks before it are stitched */
+    struct LexicalError {
+        int         code;
+        std::string message;
+        int         line;
     };
 
+    /* How the scan of a chunk ended, see scan_parallel */
+    enum class ChunkEnd {
+        CLEAN,       // reached the end of the chunk between two lexemes
+        OPEN_STRING, // a string runs past the end of the chunk
+        HALTED,      // stopped on the EOF byte, like the sequential scan would
+    };
+
+    struct ChunkScan {
+        std::vector<Token>        tokens;
+        std::vector<LexicalError> errors;
+        int                       newlines    = 0;
+        ChunkEnd                  end         = ChunkEnd::CLEAN;
+        size_t                    open_string = 0;
+    };
+
+    /* View into a source buffer owned by the caller, which must outlive the produced tokens */
+    std::string_view          source;
+    std::vector<LexicalError> errors;
+
+    /* The token produced by the last scanned lexeme, if any */
+    Token token{};
+    bool  has_token = false;
+
     void collect_err(int err_code, std::string message, int line);
 
     /** Using two pointers to scan the source.
@@ -71,15 +78,42 @@ class Scanner {
 
     void add_token(TokenType type, const Literal& literal = nullptr);
 
+    /* Scans one lexeme, which produces at most one token */
+    void scan_lexeme();
+
     void handle_slash();
     void handle_string();
     void handle_number();
     void handle_identifier();
 
+    /* Scans source[begin, end) on its own, lines are counted from 1 */
+    static ChunkScan scan_chunk(std::string_view source, size_t begin, size_t end);
+
+    /* Splits the source right after newlines into at most `count` chunks, returns their starts and the end */
+    static std::vector<size_t> chunk_bounds(std::string_view source, size_t count);
+
 public:
-    ~Scanner() = default;
+    /* Sources smaller than this are not worth splitting across threads */
+    static constexpr size_t PARALLEL_MIN_SIZE = 4 << 20;
+
+    /* Smallest chunk handed to a worker */
+    static constexpr size_t PARALLEL_MIN_CHUNK = 1 << 20;
+
+    ~Scanner() override = default;
 
+    Token          next_token() override;
     ScanResult     scan_tokens();
-    static Scanner from_source(const std::string& source);
+    static Scanner from_source(std::string_view source);
+    /* Starts at `offset`, which must lie between two lexemes, counting lines from `line` */
+    static Scanner from_source(std::string_view source, size_t offset, int line);
     bool           success() const;
+
+    /**
+     * Scans newline aligned chunks of the source on `workers` threads and stitches the results.
+     * Strings crossing a chunk edge are rescanned sequentially, the result is identical to scan_tokens().
+     */
+    static ScanResult scan_parallel(std::string_view source, unsigned workers);
+
+    [[nodiscard]]
+    std::vector<Error> collected_errors() const;
 };
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+struct Callable;
+
+/**
+ * A value of the language in 8 bytes, NaN-boxed. A double is stored as itself. Every other kind is stored
+ * in a quiet NaN with the sign bit set and the top two mantissa bits set: a 2-bit tag, then 48 bits of
+ * payload. nil and booleans sit in the payload. Strings and functions are pointers to heap objects,
+ * reference counted by the values holding them.
+ *
+ * Joining strings links them in a rope instead of copying their text, which is only copied once, when the
+ * string is read. Appending to a string in a loop is then linear in the length of the result.
+ *
+ * Arithmetic never produces such a NaN, the default NaN clears the second mantissa bit. A double that
+ * has those bits anyway is stored as the default NaN, which prints the same.
+ */
+class Value;
+
+class Value {
+    enum Tag : uint64_t {
+        NIL,
+        BOOL,
+        STRING,
+        CALLABLE,
+    };
+
+    static constexpr uint64_t BOXED       = 0xFFFC'0000'0000'0000;
+    static constexpr uint64_t PAYLOAD     = 0x0000'FFFF'FFFF'FFFF;
+    static constexpr uint64_t DEFAULT_NAN = 0xFFF8'0000'0000'0000;
+    /* Set in the tags of heap objects, STRING and CALLABLE */
+    static constexpr uint64_t OBJECT = BOXED | uint64_t{2} << 48;
+
+    /* Header of the heap objects, counting the values holding them */
+    struct Object {
+        uint32_t references = 1;
+    };
+
+    /* Flat text, or the concatenation of `left` and `right` until it is read. Never modified once read */
+    struct String : Object {
+        std::string text;
+        size_t      length = text.size();
+        String*     left   = nullptr;
+        String*     right  = nullptr;
+        /* Hash of the text, 0 until computed */
+        size_t hash = 0;
+    };
+
+    /* Strings up to this length are copied when joined, shorter than a rope node */
+    static constexpr size_t FLAT_LENGTH = 64;
+
+    struct Function : Object {
+        std::shared_ptr<Callable> callable;
+    };
+
+    uint64_t bits;
+
+    static constexpr uint64_t box(const Tag tag, const uint64_t payload) {
+        return BOXED | tag << 48 | payload;
+    }
+
+    [[nodiscard]]
+    Object* object() const {
+        return reinterpret_cast<Object*>(bits & PAYLOAD);
+    }
+
+    [[nodiscard]]
+    bool is_object() const {
+        return (bits & OBJECT) == OBJECT;
+    }
+
+    void retain() const {
+        if(is_object())
+            object()->references++;
+    }
+
+    void release() const {
+        if(is_object() && --object()->references == 0)
+            destroy();
+    }
+
+    void destroy() const;
+
+    explicit Value(String* string) : bits(box(STRING, reinterpret_cast<uint64_t>(string))) {}
+
+    static void release(String* string);
+    static void destroy(String* string);
+    /* Copies the text of a rope into its root, then lets go of the rest of it */
+    static void flatten(String& string);
+
+public:
+    Value() noexcept : bits(box(NIL, 0)) {}
+    Value(std::nullptr_t) noexcept : Value() {}
+    Value(const double number) noexcept : bits(std::bit_cast<uint64_t>(number)) {
+        if((bits & BOXED) == BOXED)
+            bits = DEFAULT_NAN;
+    }
+    Value(const bool boolean) noexcept : bits(box(BOOL, boolean)) {}
+    Value(std::string text);
+    Value(const char* text) : Value(std::string(text)) {}
+    Value(std::shared_ptr<Callable> callable);
+
+    template<class T>
+        requires std::is_convertible_v<T*, Callable*>
+    Value(std::shared_ptr<T> callable) : Value(std::shared_ptr<Callable>(std::move(callable))) {}
+
+    /* Any other pointer would silently become a boolean */
+    template<class T>
+    Value(T*) = delete;
+
+    /* The strings `left` then `right`, joined in constant time */
+    static Value concat(const Value& left, const Value& right);
+
+    Value(const Value& other) noexcept : bits(other.bits) {
+        retain();
+    }
+    Value(Value&& other) noexcept : bits(std::exchange(other.bits, box(NIL, 0))) {}
+
+    Value& operator=(const Value& other) noexcept {
+        other.retain();
+        release();
+        bits = other.bits;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if(this != &other) {
+            release();
+            bits = std::exchange(other.bits, box(NIL, 0));
+        }
+        return *this;
+    }
+
+    ~Value() {
+        release();
+    }
+
+    [[nodiscard]]
+    bool is_nil() const {
+        return bits == box(NIL, 0);
+    }
+    [[nodiscard]]
+    bool is_number() const {
+        return (bits & BOXED) != BOXED;
+    }
+    [[nodiscard]]
+    bool is_bool() const {
+        return (bits & ~uint64_t{1}) == box(BOOL, 0);
+    }
+    [[nodiscard]]
+    bool is_string() const {
+        return (bits & ~PAYLOAD) == box(STRING, 0);
+    }
+    [[nodiscard]]
+    bool is_callable() const {
+        return (bits & ~PAYLOAD) == box(CALLABLE, 0);
+    }
+
+    /* Same bits: the same nil or boolean, the same heap object, or a number with the same bits */
+    [[nodiscard]]
+    bool is_identical(const Value& other) const {
+        return bits == other.bits;
+    }
+
+    /* Each of these requires the value to be of its kind */
+    [[nodiscard]]
+    double as_number() const {
+        return std::bit_cast<double>(bits);
+    }
+    [[nodiscard]]
+    bool as_bool() const {
+        return (bits & 1) != 0;
+    }
+    [[nodiscard]]
+    const std::string& as_string() const {
+        auto* string = static_cast<String*>(object());
+        if(string->left)
+            flatten(*string);
+        return string->text;
+    }
+    /* Length of a string, without reading its text */
+    [[nodiscard]]
+    size_t length() const {
+        return static_cast<const String*>(object())->length;
+    }
+    /* Hash of a string's text, computed once */
+    [[nodiscard]]
+    size_t hash() const;
+
+    /* Whether two strings have the same text, compared only if their lengths and any known hashes match */
+    static bool equal_strings(const Value& left, const Value& right);
+    [[nodiscard]]
+    const std::shared_ptr<Callable>& as_callable() const {
+        return static_cast<const Function*>(object())->callable;
+    }
+};
+
+static_assert(sizeof(Value) == 8);
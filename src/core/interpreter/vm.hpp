@@ -0,0 +1,52 @@
+#pragma once
+
+#include "interpreter/bytecode.hpp"
+#include "interpreter/interpreter.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Runs programs compiled to bytecode by the Compiler, an alternative to walking their tree.
+ *
+ * Frames share one contiguous register file, a callee's registers start right after its callee register in
+ * the caller, where the arguments were evaluated, so they are its parameters without being copied. Calls to
+ * functions do not recurse on the C++ stack, tail calls reuse the frame they end.
+ *
+ * Globals, native functions, environments and function values are the interpreter's, a function body is
+ * readied by it on its first call then compiled once. Errors are the interpreter's too, on the same lines.
+ */
+class Vm;
+
+class Vm {
+    struct Frame {
+        const Chunk*                 chunk;
+        const Instr*                 ip;
+        size_t                       base;
+        std::shared_ptr<Environment> env;
+        /* Register of the caller receiving the value returned */
+        size_t ret;
+        /* Function running, kept alive while its chunk runs */
+        std::shared_ptr<Callable> callee;
+    };
+
+    Interpreter&       interpreter;
+    std::vector<Value> registers;
+    std::vector<Frame> frames;
+
+    std::unordered_map<const FuncBody*, std::unique_ptr<Chunk>> chunks;
+
+    /* The chunk of a function body, compiled on its first call */
+    const Chunk& compiled(const Func& func);
+
+    /* Grows the register file to hold `size` registers, moving it */
+    void ensure(size_t size);
+
+    void execute();
+
+public:
+    explicit Vm(Interpreter& interpreter) : interpreter(interpreter) {}
+
+    void run(const Program& program);
+};
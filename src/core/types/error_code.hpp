@@ -32,5 +32,6 @@ constexpr int UNDEFINED_VAR           = 202;
 constexpr int DUPLICATE_VAR           = 203;
 constexpr int ARGUMENT_COUNT_MISMATCH = 204;
 constexpr int NOT_CALLABLE            = 205;
+constexpr int TOO_MANY_REGISTERS      = 206;
 
 } // namespace err
@@ -1,9 +1,42 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <string_view>
 
 namespace utils {
 
-std::string read_file_contents(const std::string& path);
+/**
+ * Read-only source text that stays at a fixed address for as long as the buffer lives.
+ * Regular files are memory mapped instead of copied. Other files, such as pipes, and strings are copied
+ * into a heap block.
+ * Tokens keep views into the buffer, so it must outlive the scanner, the parser and the interpreter.
+ */
+class SourceBuffer;
 
-}
\ No newline at end of file
+class SourceBuffer {
+    const char*             bytes  = nullptr;
+    size_t                  length = 0;
+    bool                    mapped = false;
+    std::unique_ptr<char[]> owned;
+
+    SourceBuffer() = default;
+
+public:
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(const SourceBuffer&)            = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    static SourceBuffer map_file(const std::string& path);
+    /* Copies the file, for one that may be rewritten while the buffer lives */
+    static SourceBuffer read_file(const std::string& path);
+    static SourceBuffer from_string(std::string_view text);
+
+    [[nodiscard]]
+    std::string_view view() const;
+};
+
+} // namespace utils
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace utils {
+
+/**
+ * Text of a formatted number, held inline so formatting never allocates.
+ * Large enough for the longest fixed notation of a double.
+ */
+struct NumberText {
+    std::array<char, 336> chars{};
+    size_t                length = 0;
+
+    [[nodiscard]]
+    std::string_view view() const {
+        return {chars.data(), length};
+    }
+};
+
+/* Parses a decimal literal the scanner has already validated */
+double parse_number_literal(std::string_view text);
+
+/*
+ Parses the whole text as a number the way std::stod would, leading spaces, a sign and
+ hexadecimal are accepted. Returns nullopt when the text is not entirely a representable number
+ */
+std::optional<double> parse_number(std::string_view text);
+
+/* Integral numbers print without decimals, any other number with six of them */
+NumberText format_number(double number);
+
+void append_number(std::string& out, double number);
+
+} // namespace utils
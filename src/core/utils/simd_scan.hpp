@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * Block-at-a-time search helpers for the scanner.
+ * Each helper returns the index of the first byte at or after `from` that stops the run,
+ * or text.size() when the run reaches the end of the text.
+ * AVX2 is used when the build enables it, SSE2 otherwise on x86-64, with a scalar fallback.
+ */
+namespace utils {
+
+/* Skips spaces and tabs, newlines are left to the scanner to count lines */
+size_t skip_blanks(std::string_view text, size_t from);
+
+/* Skips a comment body up to the newline ending it */
+size_t skip_to_line_end(std::string_view text, size_t from);
+
+/* Skips a string body up to its closing double quote */
+size_t skip_to_quote(std::string_view text, size_t from);
+
+/* Skips identifier characters: letters, digits and underscore */
+size_t skip_identifier_chars(std::string_view text, size_t from);
+
+} // namespace utils
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+/**
+ * Interned identifier. Every distinct name is stored once in a process-wide table and
+ * equal names share one id, so comparing symbols is an integer compare and hashing
+ * them reuses the hash computed when the name was first interned.
+ * The table is safe to intern into from several threads and is never shrunk.
+ */
+struct Symbol;
+
+struct Symbol {
+    uint32_t id   = 0;
+    uint32_t hash = 0;
+
+    static Symbol intern(std::string_view name);
+
+    /* The interned name, valid for the rest of the process */
+    [[nodiscard]]
+    std::string_view name() const;
+
+    bool operator==(const Symbol& other) const {
+        return id == other.id;
+    }
+};
+
+template <>
+struct std::hash<Symbol> {
+    size_t operator()(const Symbol symbol) const noexcept {
+        return symbol.hash;
+    }
+};
@@ -11,4 +11,7 @@ std::string to_string(TokenType type);
 
 std::string to_string(const Value& value);
 
+/* Appends the string form of the value, without building an intermediate string */
+void append_string(std::string& out, const Value& value);
+
 } // namespace utils
\ No newline at end of file
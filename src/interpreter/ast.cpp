@@ -0,0 +1,215 @@
+#include "interpreter/ast.hpp"
+
+#include "utils/templ.hpp"
+
+namespace {
+
+template <class T>
+NodeList<T> append_list(std::vector<T>& pool, const std::span<const T> items) {
+    const auto list = NodeList<T>{static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(items.size())};
+    pool.insert(pool.end(), items.begin(), items.end());
+    return list;
+}
+
+template <class T>
+std::span<const T> view_list(const std::vector<T>& pool, const NodeList<T> list) {
+    return {pool.data() + list.begin, list.size};
+}
+
+} // namespace
+
+ExprId Ast::add(Expr expr, const int line) {
+    exprs.push_back(std::move(expr));
+    expr_lines.push_back(line);
+    return static_cast<ExprId>(exprs.size() - 1);
+}
+
+StmtId Ast::add(Stmt stmt) {
+    stmts.push_back(std::move(stmt));
+    return static_cast<StmtId>(stmts.size() - 1);
+}
+
+NodeList<ExprId> Ast::add_list(const std::span<const ExprId> items) {
+    return append_list(expr_lists, items);
+}
+
+NodeList<StmtId> Ast::add_list(const std::span<const StmtId> items) {
+    return append_list(stmt_lists, items);
+}
+
+NodeList<Name> Ast::add_list(const std::span<const Name> items) {
+    return append_list(name_lists, items);
+}
+
+NodeList<Coord> Ast::add_list(const std::span<const Coord> items) {
+    return append_list(coord_lists, items);
+}
+
+StringId Ast::add_string(const std::string_view text) {
+    // Hashed right away, comparisons with other strings can then often be decided without reading them.
+    // Only the cached hash is wanted here, the value returned is not
+    strings.emplace_back(std::string(text));
+    (void)strings.back().hash();
+    return static_cast<StringId>(strings.size() - 1);
+}
+
+BodyId Ast::add_body(FuncBody body) {
+    bodies.push_back(std::move(body));
+    return static_cast<BodyId>(bodies.size() - 1);
+}
+
+const Expr& Ast::expr(const ExprId id) const {
+    return exprs[static_cast<uint32_t>(id)];
+}
+
+Expr& Ast::expr(const ExprId id) {
+    return exprs[static_cast<uint32_t>(id)];
+}
+
+int Ast::line(const ExprId id) const {
+    return expr_lines[static_cast<uint32_t>(id)];
+}
+
+const Stmt& Ast::stmt(const StmtId id) const {
+    return stmts[static_cast<uint32_t>(id)];
+}
+
+Stmt& Ast::stmt(const StmtId id) {
+    return stmts[static_cast<uint32_t>(id)];
+}
+
+std::span<const ExprId> Ast::list(const NodeList<ExprId> list) const {
+    return view_list(expr_lists, list);
+}
+
+std::span<ExprId> Ast::list(const NodeList<ExprId> list) {
+    return {expr_lists.data() + list.begin, list.size};
+}
+
+std::span<const StmtId> Ast::list(const NodeList<StmtId> list) const {
+    return view_list(stmt_lists, list);
+}
+
+std::span<StmtId> Ast::list(const NodeList<StmtId> list) {
+    return {stmt_lists.data() + list.begin, list.size};
+}
+
+std::span<const Name> Ast::list(const NodeList<Name> list) const {
+    return view_list(name_lists, list);
+}
+
+std::span<Name> Ast::list(const NodeList<Name> list) {
+    return {name_lists.data() + list.begin, list.size};
+}
+
+std::span<const Coord> Ast::list(const NodeList<Coord> list) const {
+    return view_list(coord_lists, list);
+}
+
+const std::string& Ast::string(const StringId id) const {
+    return strings[static_cast<uint32_t>(id)].as_string();
+}
+
+const Value& Ast::string_value(const StringId id) const {
+    return strings[static_cast<uint32_t>(id)];
+}
+
+const FuncBody& Ast::body(const BodyId id) const {
+    return bodies[static_cast<uint32_t>(id)];
+}
+
+size_t Ast::size() const {
+    return exprs.size() + stmts.size();
+}
+
+void Ast::shift_lines(const StmtId id, const int delta) {
+    if(id == StmtId::NONE)
+        return;
+    const auto shift_names = [this, delta](const NodeList<Name> names) {
+        for(uint32_t k = names.begin; k < names.begin + names.size; k++)
+            name_lists[k].line += delta;
+    };
+    std::visit(
+        overloaded{
+            [&](ExprStmt& stmt) { shift_expr_lines(stmt.expr, delta); },
+            [&](IfStmt& stmt) {
+                shift_expr_lines(stmt.condition, delta);
+                shift_lines(stmt.then_branch, delta);
+                shift_lines(stmt.else_branch, delta);
+            },
+            [&](VarDeclStmt& stmt) {
+                stmt.name.line += delta;
+                shift_expr_lines(stmt.initializer, delta);
+            },
+            [&](FuncDeclStmt& stmt) {
+                stmt.name.line += delta;
+                shift_names(stmt.params);
+                shift_body_lines(stmt.body, delta);
+            },
+            [&](const BlockStmt& stmt) {
+                for(const auto statement : list(stmt.statements))
+                    shift_lines(statement, delta);
+            },
+            [&](const WhileStmt& stmt) {
+                shift_expr_lines(stmt.condition, delta);
+                shift_lines(stmt.body, delta);
+            },
+            [&](const ReturnStmt& stmt) { shift_expr_lines(stmt.value, delta); },
+            [](const auto&) {},
+        },
+        stmt(id));
+}
+
+void Ast::shift_expr_lines(const ExprId id, const int delta) {
+    if(id == ExprId::NONE)
+        return;
+    expr_lines[static_cast<uint32_t>(id)] += delta;
+    std::visit(
+        overloaded{
+            [&](const Binary& expr) {
+                shift_expr_lines(expr.left, delta);
+                shift_expr_lines(expr.right, delta);
+            },
+            [&](const Logical& expr) {
+                shift_expr_lines(expr.left, delta);
+                shift_expr_lines(expr.right, delta);
+            },
+            [&](const Unary& expr) { shift_expr_lines(expr.right, delta); },
+            [&](const Grouping& expr) { shift_expr_lines(expr.expr, delta); },
+            [&](const Assign& expr) { shift_expr_lines(expr.value, delta); },
+            [&](const Call& expr) {
+                shift_expr_lines(expr.callee, delta);
+                for(const auto arg : list(expr.args))
+                    shift_expr_lines(arg, delta);
+            },
+            [&](const Lambda& expr) {
+                for(uint32_t k = expr.params.begin; k < expr.params.begin + expr.params.size; k++)
+                    name_lists[k].line += delta;
+                shift_body_lines(expr.body, delta);
+            },
+            [](const auto&) {},
+        },
+        exprs[static_cast<uint32_t>(id)]);
+}
+
+void Ast::shift_body_lines(const BodyId id, const int delta) {
+    auto& body = bodies[static_cast<uint32_t>(id)];
+    body.line += delta;
+    // A body parsed into an arena of its own is not part of this tree
+    if(body.deferred || body.ast)
+        return;
+    for(const auto stmt : list(body.statements))
+        shift_lines(stmt, delta);
+}
+
+void Ast::clear() {
+    exprs.clear();
+    expr_lines.clear();
+    stmts.clear();
+    expr_lists.clear();
+    stmt_lists.clear();
+    name_lists.clear();
+    coord_lists.clear();
+    strings.clear();
+    bodies.clear();
+}
@@ -0,0 +1,540 @@
+#include "interpreter/closure.hpp"
+
+#include "interpreter/layout.hpp"
+#include "types/error_code.hpp"
+#include "utils/errorx.hpp"
+#include "utils/templ.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+
+/**
+ * Turns resolved code into closures. The Layout decides which locals sit in the frame's array and which in
+ * environments. Every expression returns its value to the closure of its parent, nothing is kept in between.
+ */
+class ClosureEngine::Builder {
+    using StoreFn = std::function<void(Frame&, const Value&)>;
+
+    ClosureEngine&                   engine;
+    const Ast&                       ast;
+    const std::shared_ptr<const Ast> shared;
+    const bool                       function;
+    Environment* const               globals;
+    Layout                           layout;
+
+    ExprFn load(const Symbol name, const std::span<const Coord> coords) const {
+        auto found = layout.place(coords);
+        switch(found.kind) {
+        case Layout::Place::REGISTER:
+            return [index = found.index](const Frame& frame) { return frame.locals[index]; };
+        case Layout::Place::ENVIRONMENT:
+            return [coords = std::move(found.coords), name, globals = globals](const Frame& frame) {
+                for(const auto coord : coords) {
+                    if(const auto& slot = frame.env->at(coord))
+                        return *slot;
+                }
+                return globals->get(name);
+            };
+        default:
+            return [name, globals = globals](const Frame&) { return globals->get(name); };
+        }
+    }
+
+    StoreFn store(const Symbol name, const std::span<const Coord> coords) const {
+        auto found = layout.place(coords);
+        switch(found.kind) {
+        case Layout::Place::REGISTER:
+            return [index = found.index](const Frame& frame, const Value& value) { frame.locals[index] = value; };
+        case Layout::Place::ENVIRONMENT:
+            return [coords = std::move(found.coords), name, globals = globals](const Frame& frame, const Value& value) {
+                for(const auto coord : coords) {
+                    if(auto& slot = frame.env->at(coord)) {
+                        *slot = value;
+                        return;
+                    }
+                }
+                globals->assign(name, value);
+            };
+        default:
+            return [name, globals = globals](const Frame&, const Value& value) { globals->assign(name, value); };
+        }
+    }
+
+    StmtFn declare(const Name& name, const ExprId initializer, const FuncDeclStmt* func, const bool value) {
+        // Built before the slot is marked declared, the initializer reads any outer variable of the same name
+        ExprFn init;
+        if(func) {
+            init = [shared = shared, params = func->params, body = func->body, symbol = func->name.symbol](
+                       const Frame& frame) -> Value {
+                return std::shared_ptr<Callable>(std::make_shared<Func>(shared, params, body, frame.env, symbol));
+            };
+        } else if(initializer != ExprId::NONE) {
+            init = expr(initializer);
+        } else {
+            init = [](const Frame&) -> Value { return nullptr; };
+        }
+        // A declaration ending a body leaves the value it declares as the result, nil for a function
+        const bool keep = value && !func;
+        const bool nil  = value && func;
+
+        if(layout.blocks.empty()) {
+            return [init = std::move(init), name, keep, nil, globals = globals](Frame& frame) {
+                const auto declared = init(frame);
+                globals->define(name, declared);
+                if(keep)
+                    frame.result = declared;
+                else if(nil)
+                    frame.result = nullptr;
+                return ExecControl::NORMAL;
+            };
+        }
+        auto& block = layout.blocks.back();
+        if(block.captured) {
+            block.declared[name.slot] = true;
+            return [init = std::move(init), name, keep, nil](Frame& frame) {
+                const auto declared = init(frame);
+                frame.env->define(name, declared);
+                if(keep)
+                    frame.result = declared;
+                else if(nil)
+                    frame.result = nullptr;
+                return ExecControl::NORMAL;
+            };
+        }
+        if(block.declared[name.slot]) {
+            return [init = std::move(init), name](Frame& frame) -> ExecControl {
+                auto declared = std::optional<Value>(nullptr);
+                Environment::define(declared, name, init(frame));
+                return ExecControl::NORMAL;
+            };
+        }
+        block.declared[name.slot] = true;
+        return [init = std::move(init), index = block.base + name.slot, keep, nil](Frame& frame) {
+            frame.locals[index] = init(frame);
+            if(keep)
+                frame.result = frame.locals[index];
+            else if(nil)
+                frame.result = nullptr;
+            return ExecControl::NORMAL;
+        };
+    }
+
+    StmtFn statements(const std::span<const StmtId> statements, const bool value) {
+        if(statements.empty()) {
+            if(!value)
+                return [](const Frame&) { return ExecControl::NORMAL; };
+            return [](Frame& frame) {
+                frame.result = nullptr;
+                return ExecControl::NORMAL;
+            };
+        }
+        auto list = std::vector<StmtFn>{};
+        for(size_t k = 0; k < statements.size(); k++)
+            list.push_back(statement(statements[k], value && k + 1 == statements.size()));
+        if(list.size() == 1)
+            return std::move(list.front());
+        return [list = std::move(list)](Frame& frame) {
+            for(const auto& stmt : list) {
+                if(const auto control = stmt(frame); control != ExecControl::NORMAL)
+                    return control;
+            }
+            return ExecControl::NORMAL;
+        };
+    }
+
+    StmtFn statement(const StmtId id, const bool value) {
+        return std::visit(
+            overloaded{
+                [&](const ExprStmt& stmt) -> StmtFn {
+                    auto run = expr(stmt.expr);
+                    if(value) {
+                        return [run = std::move(run)](Frame& frame) {
+                            frame.result = run(frame);
+                            return ExecControl::NORMAL;
+                        };
+                    }
+                    return [run = std::move(run)](Frame& frame) {
+                        run(frame);
+                        return ExecControl::NORMAL;
+                    };
+                },
+                [&](const IfStmt& stmt) -> StmtFn {
+                    auto condition = expr(stmt.condition);
+                    auto then      = statement(stmt.then_branch, value);
+                    if(stmt.else_branch != StmtId::NONE) {
+                        return [condition = std::move(condition),
+                                then      = std::move(then),
+                                otherwise = statement(stmt.else_branch, value)](Frame& frame) {
+                            return Interpreter::is_truthy(condition(frame)) ? then(frame) : otherwise(frame);
+                        };
+                    }
+                    // Without an else, a false condition leaves nil as the result
+                    return [condition = std::move(condition), then = std::move(then), value](Frame& frame) {
+                        if(Interpreter::is_truthy(condition(frame)))
+                            return then(frame);
+                        if(value)
+                            frame.result = nullptr;
+                        return ExecControl::NORMAL;
+                    };
+                },
+                [&](const VarDeclStmt& stmt) { return declare(stmt.name, stmt.initializer, nullptr, value); },
+                [&](const FuncDeclStmt& stmt) { return declare(stmt.name, ExprId::NONE, &stmt, value); },
+                [&](const BlockStmt& stmt) -> StmtFn {
+                    layout.enter(stmt.slots, stmt.captured);
+                    auto body = statements(ast.list(stmt.statements), value);
+                    layout.leave();
+                    if(!stmt.captured)
+                        return body;
+                    return [body = std::move(body), slots = stmt.slots](Frame& frame) {
+                        auto enclosing = frame.env;
+                        frame.env      = std::make_shared<Environment>(enclosing, slots);
+                        const auto control = body(frame);
+                        frame.env          = std::move(enclosing);
+                        return control;
+                    };
+                },
+                [&](const WhileStmt& stmt) { return loop(stmt, value); },
+                [&](const BreakStmt) -> StmtFn { return [](const Frame&) { return ExecControl::BREAK; }; },
+                [&](const ContinueStmt) -> StmtFn { return [](const Frame&) { return ExecControl::CONTINUE; }; },
+                [&](const ReturnStmt& stmt) -> StmtFn {
+                    auto run = stmt.value != ExprId::NONE ? expr(stmt.value) : ExprFn{};
+                    // A return at the top level only ends its own statement, its value is dropped
+                    if(!function) {
+                        return [run = std::move(run)](Frame& frame) {
+                            if(run)
+                                run(frame);
+                            return ExecControl::RETURN;
+                        };
+                    }
+                    if(!run) {
+                        return [](Frame& frame) {
+                            frame.result = nullptr;
+                            return ExecControl::RETURN;
+                        };
+                    }
+                    return [run = std::move(run)](Frame& frame) {
+                        frame.result = run(frame);
+                        return ExecControl::RETURN;
+                    };
+                },
+            },
+            ast.stmt(id));
+    }
+
+    StmtFn loop(const WhileStmt& stmt, const bool value) {
+        const auto hoisted = stmt.hoisted.size;
+        uint32_t   flags   = 0;
+        if(hoisted != 0) {
+            layout.enter_loop(hoisted, stmt.captured);
+            flags = layout.blocks.back().hoisted;
+        }
+        auto condition = expr(stmt.condition);
+        auto body      = statement(stmt.body, value);
+        if(hoisted != 0)
+            layout.leave();
+
+        // The result is reset to nil first, so a loop that never runs its body leaves nil
+        return [condition = std::move(condition),
+                body      = std::move(body),
+                hoisted,
+                flags,
+                captured = stmt.captured,
+                value](Frame& frame) {
+            for(uint32_t k = 0; k < hoisted; k++)
+                frame.locals[flags + 2 * k + 1] = false;
+            auto enclosing = captured ? frame.env : nullptr;
+            if(captured)
+                frame.env = std::make_shared<Environment>(enclosing, hoisted);
+            if(value)
+                frame.result = nullptr;
+            auto control = ExecControl::NORMAL;
+            while(Interpreter::is_truthy(condition(frame))) {
+                const auto ran = body(frame);
+                if(ran == ExecControl::BREAK)
+                    break;
+                if(ran == ExecControl::RETURN) {
+                    control = ran;
+                    break;
+                }
+            }
+            if(captured)
+                frame.env = std::move(enclosing);
+            return control;
+        };
+    }
+
+    template<BinaryOp op>
+    static ExprFn binary(ExprFn left, ExprFn right, const int line) {
+        // Both operands numbers is the case worth a closure of its own, the rest reuses the interpreter's code
+        return [left = std::move(left), right = std::move(right), line](Frame& frame) -> Value {
+            const auto lhs = left(frame);
+            const auto rhs = right(frame);
+            if(!lhs.is_number() || !rhs.is_number())
+                return Interpreter::binary(op, lhs, rhs, line);
+            const double l = lhs.as_number();
+            const double r = rhs.as_number();
+            if constexpr(op == BinaryOp::ADD)
+                return l + r;
+            else if constexpr(op == BinaryOp::SUBTRACT)
+                return l - r;
+            else if constexpr(op == BinaryOp::MULTIPLY)
+                return l * r;
+            else if constexpr(op == BinaryOp::DIVIDE)
+                return l / r;
+            else if constexpr(op == BinaryOp::MODULO)
+                return std::fmod(l, r);
+            else if constexpr(op == BinaryOp::GREATER)
+                return l > r;
+            else if constexpr(op == BinaryOp::GREATER_EQUAL)
+                return l >= r;
+            else if constexpr(op == BinaryOp::LESS)
+                return l < r;
+            else if constexpr(op == BinaryOp::LESS_EQUAL)
+                return l <= r;
+            else if constexpr(op == BinaryOp::EQUAL)
+                return l == r;
+            else
+                return l != r;
+        };
+    }
+
+    ExprFn binary(const Binary& node, const int line) {
+        auto left  = expr(node.left);
+        auto right = expr(node.right);
+        switch(node.op) {
+        case BinaryOp::ADD:
+            return binary<BinaryOp::ADD>(std::move(left), std::move(right), line);
+        case BinaryOp::SUBTRACT:
+            return binary<BinaryOp::SUBTRACT>(std::move(left), std::move(right), line);
+        case BinaryOp::MULTIPLY:
+            return binary<BinaryOp::MULTIPLY>(std::move(left), std::move(right), line);
+        case BinaryOp::DIVIDE:
+            return binary<BinaryOp::DIVIDE>(std::move(left), std::move(right), line);
+        case BinaryOp::MODULO:
+            return binary<BinaryOp::MODULO>(std::move(left), std::move(right), line);
+        case BinaryOp::GREATER:
+            return binary<BinaryOp::GREATER>(std::move(left), std::move(right), line);
+        case BinaryOp::GREATER_EQUAL:
+            return binary<BinaryOp::GREATER_EQUAL>(std::move(left), std::move(right), line);
+        case BinaryOp::LESS:
+            return binary<BinaryOp::LESS>(std::move(left), std::move(right), line);
+        case BinaryOp::LESS_EQUAL:
+            return binary<BinaryOp::LESS_EQUAL>(std::move(left), std::move(right), line);
+        case BinaryOp::EQUAL:
+            return binary<BinaryOp::EQUAL>(std::move(left), std::move(right), line);
+        default:
+            return binary<BinaryOp::NOT_EQUAL>(std::move(left), std::move(right), line);
+        }
+    }
+
+    ExprFn call(const Call& node, const int line) {
+        auto callee = expr(node.callee);
+        auto args   = std::vector<ExprFn>{};
+        for(const auto arg : ast.list(node.args))
+            args.push_back(expr(arg));
+        const bool tail = function && node.tail;
+        return [callee = std::move(callee), args = std::move(args), line, tail, &engine = engine](
+                   Frame& frame) -> Value {
+            const auto target = callee(frame);
+            // Arguments are evaluated only once the callee is known to accept them, the interpreter's error order
+            if(!target.is_callable())
+                throw err::make(err::NOT_CALLABLE, "Can only call functions.", line);
+            const auto& callable = target.as_callable();
+            if(args.size() != callable->arity())
+                throw err::make(
+                    err::ARGUMENT_COUNT_MISMATCH,
+                    std::format("Expected {} arguments but got {}.", callable->arity(), args.size()),
+                    line);
+            auto arguments = std::vector<Value>{};
+            arguments.reserve(args.size());
+            for(const auto& arg : args)
+                arguments.push_back(arg(frame));
+            if(const auto* func = dynamic_cast<const Func*>(callable.get())) {
+                if(!tail)
+                    return engine.call(*func, std::move(arguments));
+                // Made by the loop of the call running, once this one has ended
+                engine.tail_callee = callable;
+                engine.tail_args   = std::move(arguments);
+                return nullptr;
+            }
+            return callable->call(engine.interpreter, arguments).value;
+        };
+    }
+
+    ExprFn expr(const ExprId id) {
+        const int line = ast.line(id);
+        return std::visit(
+            overloaded{
+                [&](const Binary& node) { return binary(node, line); },
+                [&](const Grouping& grouping) { return expr(grouping.expr); },
+                [&](const Unary& unary) -> ExprFn {
+                    auto right = expr(unary.right);
+                    if(unary.op == UnaryOp::NOT)
+                        return [right = std::move(right)](Frame& frame) -> Value {
+                            return !Interpreter::is_truthy(right(frame));
+                        };
+                    return [right = std::move(right), line](Frame& frame) -> Value {
+                        const auto operand = right(frame);
+                        if(operand.is_number())
+                            return -operand.as_number();
+                        return Interpreter::unary(UnaryOp::NEGATE, operand, line);
+                    };
+                },
+                [&](const Literal& literal) -> ExprFn {
+                    auto constant = std::visit(
+                        overloaded{
+                            [&](const StringId string) { return ast.string_value(string); },
+                            [](const auto& other) { return Value(other); },
+                        },
+                        literal);
+                    return [constant = std::move(constant)](const Frame&) { return constant; };
+                },
+                [&](const Variable& variable) { return load(variable.name, ast.list(variable.coords)); },
+                [&](const Assign& assigned) -> ExprFn {
+                    auto value = expr(assigned.value);
+                    auto write = store(assigned.name, ast.list(assigned.coords));
+                    return [value = std::move(value), write = std::move(write)](Frame& frame) {
+                        auto result = value(frame);
+                        write(frame, result);
+                        return result;
+                    };
+                },
+                [&](const Logical& logical) -> ExprFn {
+                    auto left  = expr(logical.left);
+                    auto right = expr(logical.right);
+                    const bool shortcut = logical.op == LogicalOp::OR;
+                    return [left = std::move(left), right = std::move(right), shortcut](Frame& frame) {
+                        auto value = left(frame);
+                        if(Interpreter::is_truthy(value) == shortcut)
+                            return value;
+                        return right(frame);
+                    };
+                },
+                [&](const Call& node) { return call(node, line); },
+                [&](const Lambda& lambda) -> ExprFn {
+                    return [shared = shared, params = lambda.params, body = lambda.body](const Frame& frame) -> Value {
+                        return std::shared_ptr<Callable>(std::make_shared<LambdaFunc>(shared, params, body, frame.env));
+                    };
+                },
+                // Inlining is an optimization of the tree-walker, this engine makes the original call
+                [&](const Inline& inlined) { return expr(inlined.call); },
+                [&](const Param&) -> ExprFn { return [](const Frame&) -> Value { return nullptr; }; },
+                [&](const Hoisted& hoisted) -> ExprFn {
+                    return [inner = expr(hoisted.expr), index = layout.hoisted(hoisted.coord)](Frame& frame) {
+                        if(!Interpreter::is_truthy(frame.locals[index + 1])) {
+                            frame.locals[index]     = inner(frame);
+                            frame.locals[index + 1] = true;
+                        }
+                        return frame.locals[index];
+                    };
+                },
+            },
+            ast.expr(id));
+    }
+
+public:
+    Builder(ClosureEngine& engine, const Ast& ast, const bool function)
+        : engine(engine), ast(ast), shared(ast.shared_from_this()), function(function),
+          globals(engine.interpreter.globals().get()) {}
+
+    /* Compiles the top level statements of a resolved program, each one on its own */
+    std::vector<StmtFn> compile(const std::span<const StmtId> program) {
+        auto list = std::vector<StmtFn>{};
+        for(const auto stmt : program)
+            list.push_back(statement(stmt, false));
+        return list;
+    }
+
+    /* Compiles a resolved function body, the call puts its arguments in the first locals of the frame */
+    Body compile(const ResolvedBody& body, const std::span<const Name> params) {
+        auto compiled = Body{.code = {}, .slots = body.slots, .captured = body.captured, .duplicate = std::nullopt};
+        if(const auto duplicate = layout.call(body.slots, body.captured, params); !body.captured)
+            compiled.duplicate = duplicate;
+        compiled.code   = statements(body.statements, true);
+        compiled.locals = layout.size;
+        return compiled;
+    }
+
+    [[nodiscard]]
+    uint32_t size() const {
+        return layout.size;
+    }
+};
+
+void ClosureEngine::run(const Program& program) {
+    auto       builder    = Builder(*this, *program.ast, false);
+    const auto statements = builder.compile(program.statements);
+    const auto size       = builder.size();
+    auto       mark       = Mark{};
+    auto       frame      = Frame{.locals = allocate(size, mark), .env = interpreter.globals(), .result = nullptr};
+    // Each top level statement is a closure of its own, a return ends only that one
+    for(const auto& stmt : statements)
+        stmt(frame);
+    release(frame.locals, size, mark);
+}
+
+const ClosureEngine::Body& ClosureEngine::compiled(const Func& func) {
+    const auto* key = &func.ast->body(func.body);
+    if(const auto it = bodies.find(key); it != bodies.end())
+        return *it->second;
+    const auto body     = interpreter.function_body(*func.ast, func.body);
+    auto       builder  = Builder(*this, body.ast, true);
+    auto       compiled = std::make_unique<Body>(builder.compile(body, func.ast->list(func.params)));
+    return *bodies.emplace(key, std::move(compiled)).first->second;
+}
+
+Value ClosureEngine::call(const Func& func, std::vector<Value> arguments) {
+    // Keeps the function of a tail call alive, once tail_callee is moved from nothing else may own it
+    std::shared_ptr<Callable> callee;
+    const Func*               current = &func;
+    while(true) {
+        const auto& body   = compiled(*current);
+        const auto  params = current->ast->list(current->params);
+        auto        mark   = Mark{};
+        auto        frame  = Frame{.locals = allocate(body.locals, mark), .env = nullptr, .result = nullptr};
+        if(body.captured) {
+            frame.env = std::make_shared<Environment>(current->closure, body.slots);
+            for(size_t k = 0; k < params.size(); k++)
+                frame.env->define(params[k], arguments[k]);
+        } else {
+            frame.env = current->closure;
+            if(body.duplicate) {
+                auto declared = std::optional<Value>(nullptr);
+                Environment::define(declared, params[*body.duplicate], arguments[*body.duplicate]);
+            }
+            std::ranges::move(arguments, frame.locals);
+        }
+        body.code(frame);
+        release(frame.locals, body.locals, mark);
+        if(!tail_callee)
+            return std::move(frame.result);
+        callee    = std::move(tail_callee);
+        arguments = std::move(tail_args);
+        current   = static_cast<const Func*>(callee.get());
+    }
+}
+
+Value* ClosureEngine::allocate(const size_t count, Mark& mark) {
+    mark = {segment, used};
+    if(segments.empty() || used + count > segments[segment].size()) {
+        // Segments after the one in use are free, the next one is replaced when too small
+        const size_t next = segments.empty() ? 0 : segment + 1;
+        if(next == segments.size())
+            segments.emplace_back(std::max(SEGMENT_SIZE, count));
+        else if(segments[next].size() < count)
+            segments[next] = std::vector<Value>(count);
+        segment = next;
+        used    = 0;
+    }
+    Value* locals = segments[segment].data() + used;
+    used += count;
+    return locals;
+}
+
+void ClosureEngine::release(Value* locals, const size_t count, const Mark mark) {
+    // Values the frame kept are dropped with it, as the interpreter drops a popped frame
+    std::fill_n(locals, count, nullptr);
+    segment = mark.segment;
+    used    = mark.used;
+}
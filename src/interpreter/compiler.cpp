@@ -0,0 +1,455 @@
+#include "interpreter/compiler.hpp"
+
+#include "utils/templ.hpp"
+
+#include <algorithm>
+#include <bit>
+
+std::unique_ptr<Chunk> Compiler::compile(const Program& program) {
+    auto chunk    = std::make_unique<Chunk>();
+    chunk->ast    = program.ast;
+    auto compiler = Compiler(*program.ast, *chunk, false);
+    for(const auto stmt : program.statements) {
+        compiler.statement(stmt, NO_REG);
+        // A return at the top level only ends its own statement, the next one still runs
+        for(const auto jump : compiler.exits)
+            compiler.patch(jump, compiler.here());
+        compiler.exits.clear();
+    }
+    const auto result = compiler.push();
+    compiler.emit(Op::LOADNIL, result);
+    compiler.emit(Op::RETURN, result);
+    chunk->registers = compiler.layout.size;
+    return chunk;
+}
+
+std::unique_ptr<Chunk> Compiler::compile(const ResolvedBody& body, const std::span<const Name> params) {
+    auto chunk    = std::make_unique<Chunk>();
+    chunk->ast    = body.ast.shared_from_this();
+    auto compiler = Compiler(body.ast, *chunk, true);
+
+    // The call scope holds the parameters, declared in order like the interpreter does on every call
+    if(body.captured) {
+        // The arguments arrive in the first registers all the same, they are moved to the environment
+        compiler.layout.reserve(static_cast<uint32_t>(params.size()));
+        compiler.emit_bx(Op::ENTER, 0, body.slots);
+        for(size_t k = 0; k < params.size(); k++)
+            compiler.emit_bx(Op::DEFINE_ENV, static_cast<uint32_t>(k), compiler.name(params[k]), params[k].line);
+    }
+    if(const auto duplicate = compiler.layout.call(body.slots, body.captured, params); duplicate && !body.captured) {
+        const auto& param = params[*duplicate];
+        compiler.emit_bx(Op::DUPLICATE, static_cast<uint32_t>(*duplicate), compiler.name(param), param.line);
+    }
+
+    const auto result = compiler.push();
+    compiler.statements(body.statements, result);
+    compiler.emit(Op::RETURN, result);
+    chunk->registers = compiler.layout.size;
+    return chunk;
+}
+
+uint32_t Compiler::emit(const Op op, const uint32_t a, const uint32_t b, const uint32_t c, const int line) {
+    chunk.code.push_back(
+        Instr{.op = op, .a = static_cast<uint16_t>(a), .b = static_cast<uint16_t>(b), .c = static_cast<uint16_t>(c)});
+    chunk.lines.push_back(line);
+    return here() - 1;
+}
+
+uint32_t Compiler::emit_bx(const Op op, const uint32_t a, const uint32_t bx, const int line) {
+    return emit(op, a, bx & UINT16_MAX, bx >> 16, line);
+}
+
+void Compiler::patch(const uint32_t jump, const uint32_t target) {
+    chunk.code[jump].b = static_cast<uint16_t>(target & UINT16_MAX);
+    chunk.code[jump].c = static_cast<uint16_t>(target >> 16);
+}
+
+uint32_t Compiler::here() const {
+    return static_cast<uint32_t>(chunk.code.size());
+}
+
+uint16_t Compiler::push() {
+    layout.reserve(1);
+    return static_cast<uint16_t>(layout.top - 1);
+}
+
+bool Compiler::is_temporary(const uint16_t reg) const {
+    return std::ranges::none_of(layout.blocks, [reg](const Layout::Block& block) {
+        return reg >= block.base && reg < block.base + block.registers;
+    });
+}
+
+uint32_t Compiler::constant(const Literal& literal) {
+    const auto index = static_cast<uint32_t>(chunk.constants.size());
+    return std::visit(
+        overloaded{
+            [&](const double number) {
+                // Keyed by bits, 0 and -0 compare equal but do not print the same
+                const auto [it, added] = numbers.try_emplace(std::bit_cast<uint64_t>(number), index);
+                if(added)
+                    chunk.constants.emplace_back(number);
+                return it->second;
+            },
+            [&](const StringId string) {
+                const auto [it, added] = strings.try_emplace(ast.string(string), index);
+                if(added)
+                    chunk.constants.push_back(ast.string_value(string));
+                return it->second;
+            },
+            [&](const auto& value) {
+                chunk.constants.emplace_back(value);
+                return index;
+            },
+        },
+        literal);
+}
+
+uint32_t Compiler::name(const Name& name) {
+    chunk.names.push_back(name);
+    return static_cast<uint32_t>(chunk.names.size() - 1);
+}
+
+uint32_t Compiler::prototype(const NodeList<Name> params, const BodyId body, const Symbol name, const bool lambda) {
+    chunk.functions.push_back({.params = params, .body = body, .name = name, .lambda = lambda});
+    return static_cast<uint32_t>(chunk.functions.size() - 1);
+}
+
+Compiler::Place Compiler::place(const Symbol name, const std::span<const Coord> coords) {
+    auto found = layout.place(coords);
+    switch(found.kind) {
+    case Layout::Place::REGISTER:
+        return {Place::REGISTER, found.index};
+    case Layout::Place::ENVIRONMENT:
+        chunk.lookups.push_back({.coords = std::move(found.coords), .name = name});
+        return {Place::ENVIRONMENT, static_cast<uint32_t>(chunk.lookups.size() - 1)};
+    default:
+        return {Place::GLOBAL, this->name(Name{.symbol = name})};
+    }
+}
+
+void Compiler::load(const Place place, const uint16_t dst) {
+    switch(place.kind) {
+    case Place::REGISTER:
+        if(place.index != dst)
+            emit(Op::MOVE, dst, place.index);
+        break;
+    case Place::ENVIRONMENT:
+        emit_bx(Op::GET_ENV, dst, place.index);
+        break;
+    case Place::GLOBAL:
+        emit_bx(Op::GET_GLOBAL, dst, place.index);
+        break;
+    }
+}
+
+void Compiler::store(const Place place, const uint16_t src) {
+    switch(place.kind) {
+    case Place::REGISTER:
+        if(place.index != src)
+            emit(Op::MOVE, place.index, src);
+        break;
+    case Place::ENVIRONMENT:
+        emit_bx(Op::SET_ENV, src, place.index);
+        break;
+    case Place::GLOBAL:
+        emit_bx(Op::SET_GLOBAL, src, place.index);
+        break;
+    }
+}
+
+void Compiler::enter(const uint32_t slots, const bool captured) {
+    if(captured)
+        emit_bx(Op::ENTER, 0, slots);
+    layout.enter(slots, captured);
+}
+
+void Compiler::leave() {
+    if(layout.blocks.back().captured)
+        emit(Op::LEAVE, 1);
+    layout.leave();
+}
+
+void Compiler::declare(const Name& name, const ExprId initializer, const FuncDeclStmt* func, const uint16_t dst) {
+    const auto value = [&](const uint16_t reg) {
+        if(func)
+            emit_bx(Op::CLOSURE, reg, prototype(func->params, func->body, func->name.symbol, false));
+        else if(initializer != ExprId::NONE)
+            expr(initializer, reg);
+        else
+            emit(Op::LOADNIL, reg);
+    };
+    // A function declaration is worth nil, a variable declaration the value it declares
+    const auto result = [&](const uint16_t reg) {
+        if(dst == NO_REG || dst == reg)
+            return;
+        if(func)
+            emit(Op::LOADNIL, dst);
+        else
+            emit(Op::MOVE, dst, reg);
+    };
+
+    // The slot is not declared yet while its initializer runs, nothing reads its register before it is
+    auto& blocks = layout.blocks;
+    if(!blocks.empty() && !blocks.back().captured && !blocks.back().declared[name.slot]) {
+        const auto reg = static_cast<uint16_t>(blocks.back().base + name.slot);
+        value(reg);
+        blocks.back().declared[name.slot] = true;
+        result(reg);
+        return;
+    }
+
+    const auto saved = layout.top;
+    const auto reg   = push();
+    value(reg);
+    if(blocks.empty()) {
+        emit_bx(Op::DEFINE_GLOBAL, reg, this->name(name), name.line);
+    } else if(blocks.back().captured) {
+        emit_bx(Op::DEFINE_ENV, reg, this->name(name), name.line);
+        blocks.back().declared[name.slot] = true;
+    } else {
+        emit_bx(Op::DUPLICATE, reg, this->name(name), name.line);
+    }
+    result(reg);
+    layout.top = saved;
+}
+
+void Compiler::statements(const std::span<const StmtId> statements, const uint16_t dst) {
+    if(statements.empty() && dst != NO_REG)
+        emit(Op::LOADNIL, dst);
+    for(size_t k = 0; k < statements.size(); k++)
+        statement(statements[k], k + 1 == statements.size() ? dst : NO_REG);
+}
+
+void Compiler::statement(const StmtId id, const uint16_t dst) {
+    std::visit(
+        overloaded{
+            [&](const ExprStmt& stmt) {
+                if(const auto* assigned = std::get_if<Assign>(&ast.expr(stmt.expr)); assigned && dst == NO_REG) {
+                    assign(*assigned, NO_REG);
+                    return;
+                }
+                const auto saved = layout.top;
+                expr(stmt.expr, dst != NO_REG ? dst : push());
+                layout.top = saved;
+            },
+            [&](const IfStmt& stmt) {
+                const auto saved = layout.top;
+                const auto skip  = emit_bx(Op::JUMP_IF_NOT, operand(stmt.condition, true), 0);
+                layout.top       = saved;
+                statement(stmt.then_branch, dst);
+                if(stmt.else_branch == StmtId::NONE && dst == NO_REG) {
+                    patch(skip, here());
+                    return;
+                }
+                const auto end = emit_bx(Op::JUMP, 0, 0);
+                patch(skip, here());
+                // No branch taken is worth nil
+                if(stmt.else_branch != StmtId::NONE)
+                    statement(stmt.else_branch, dst);
+                else
+                    emit(Op::LOADNIL, dst);
+                patch(end, here());
+            },
+            [&](const VarDeclStmt& stmt) { declare(stmt.name, stmt.initializer, nullptr, dst); },
+            [&](const FuncDeclStmt& stmt) { declare(stmt.name, ExprId::NONE, &stmt, dst); },
+            [&](const BlockStmt& stmt) {
+                enter(stmt.slots, stmt.captured);
+                statements(ast.list(stmt.statements), dst);
+                leave();
+            },
+            [&](const WhileStmt& stmt) { loop(stmt, dst); },
+            [&](const BreakStmt) {
+                jump_out(loops.back().environments);
+                loops.back().breaks.push_back(emit_bx(Op::JUMP, 0, 0));
+            },
+            [&](const ContinueStmt) {
+                jump_out(loops.back().environments);
+                emit_bx(Op::JUMP, 0, loops.back().start);
+            },
+            [&](const ReturnStmt& stmt) {
+                const auto saved = layout.top;
+                if(function) {
+                    uint16_t reg = 0;
+                    if(stmt.value != ExprId::NONE) {
+                        reg = operand(stmt.value, true);
+                    } else {
+                        reg = push();
+                        emit(Op::LOADNIL, reg);
+                    }
+                    emit(Op::RETURN, reg);
+                } else {
+                    if(stmt.value != ExprId::NONE)
+                        expr(stmt.value, push());
+                    jump_out(0);
+                    exits.push_back(emit_bx(Op::JUMP, 0, 0));
+                }
+                layout.top = saved;
+            },
+        },
+        ast.stmt(id));
+}
+
+void Compiler::loop(const WhileStmt& stmt, const uint16_t dst) {
+    const auto hoisted = stmt.hoisted.size;
+    if(hoisted != 0) {
+        if(stmt.captured)
+            emit_bx(Op::ENTER, 0, hoisted);
+        layout.enter_loop(hoisted, stmt.captured);
+        const auto computed = constant(Literal{false});
+        for(uint32_t k = 0; k < hoisted; k++)
+            emit_bx(Op::LOADK, layout.blocks.back().hoisted + 2 * k + 1, computed);
+    }
+    // A loop is worth the value of the last iteration it completed, nil when there was none
+    if(dst != NO_REG)
+        emit(Op::LOADNIL, dst);
+
+    const auto start = here();
+    const auto saved = layout.top;
+    const auto exit  = emit_bx(Op::JUMP_IF_NOT, operand(stmt.condition, true), 0);
+    layout.top       = saved;
+    loops.push_back(Loop{.start = start, .environments = layout.environments(), .breaks = {}});
+    statement(stmt.body, dst);
+    emit_bx(Op::JUMP, 0, start);
+    for(const auto jump : loops.back().breaks)
+        patch(jump, here());
+    patch(exit, here());
+    loops.pop_back();
+
+    if(hoisted != 0)
+        leave();
+}
+
+void Compiler::jump_out(const uint32_t environments_kept) {
+    if(const auto count = layout.environments() - environments_kept; count != 0)
+        emit(Op::LEAVE, count);
+}
+
+void Compiler::expr(const ExprId id, const uint16_t dst) {
+    const int line = ast.line(id);
+    std::visit(
+        overloaded{
+            [&](const Binary& binary) {
+                const auto saved = layout.top;
+                // The left operand is read when the operator runs, after the right one, which must not assign it
+                const auto left  = operand(binary.left, !assigns(binary.right));
+                const auto right = operand(binary.right, true);
+                emit(static_cast<Op>(static_cast<uint8_t>(Op::ADD) + static_cast<uint8_t>(binary.op)),
+                     dst,
+                     left,
+                     right,
+                     line);
+                layout.top = saved;
+            },
+            [&](const Grouping& grouping) { expr(grouping.expr, dst); },
+            [&](const Unary& unary) {
+                const auto saved = layout.top;
+                const auto right = operand(unary.right, true);
+                emit(unary.op == UnaryOp::NEGATE ? Op::NEGATE : Op::NOT, dst, right, 0, line);
+                layout.top = saved;
+            },
+            [&](const Literal& literal) {
+                if(std::holds_alternative<std::nullptr_t>(literal))
+                    emit(Op::LOADNIL, dst);
+                else
+                    emit_bx(Op::LOADK, dst, constant(literal));
+            },
+            [&](const Variable& variable) { load(place(variable.name, ast.list(variable.coords)), dst); },
+            [&](const Assign& assigned) { assign(assigned, dst); },
+            [&](const Logical& logical) {
+                expr(logical.left, dst);
+                const auto skip = emit_bx(logical.op == LogicalOp::OR ? Op::JUMP_IF : Op::JUMP_IF_NOT, dst, 0);
+                expr(logical.right, dst);
+                patch(skip, here());
+            },
+            [&](const Call& call) { this->call(call, id, dst); },
+            [&](const Lambda& lambda) {
+                emit_bx(Op::CLOSURE, dst, prototype(lambda.params, lambda.body, Symbol{}, true));
+            },
+            // Inlining is an optimization of the tree-walker, the VM makes the original call
+            [&](const Inline& inlined) { expr(inlined.call, dst); },
+            [&](const Param&) { emit(Op::LOADNIL, dst); },
+            [&](const Hoisted& hoisted) { this->hoisted(hoisted, dst); },
+        },
+        ast.expr(id));
+}
+
+uint16_t Compiler::operand(const ExprId id, const bool direct) {
+    // A local in a register is used where it is, anything else is evaluated into a new temporary
+    if(const auto* variable = std::get_if<Variable>(&ast.expr(id))) {
+        const auto found = place(variable->name, ast.list(variable->coords));
+        if(direct && found.kind == Place::REGISTER)
+            return static_cast<uint16_t>(found.index);
+        const auto reg = push();
+        load(found, reg);
+        return reg;
+    }
+    const auto reg = push();
+    expr(id, reg);
+    return reg;
+}
+
+void Compiler::assign(const Assign& assigned, const uint16_t dst) {
+    const auto target = place(assigned.name, ast.list(assigned.coords));
+    // An operator writes its result once its operands are read, straight into the local when nothing else needs it
+    const auto& value = ast.expr(assigned.value);
+    if(dst == NO_REG && target.kind == Place::REGISTER &&
+       (std::holds_alternative<Binary>(value) || std::holds_alternative<Unary>(value) ||
+        std::holds_alternative<Literal>(value))) {
+        expr(assigned.value, static_cast<uint16_t>(target.index));
+        return;
+    }
+    const auto saved = layout.top;
+    const auto reg   = dst != NO_REG ? dst : push();
+    expr(assigned.value, reg);
+    store(target, reg);
+    layout.top = saved;
+}
+
+void Compiler::call(const Call& call, const ExprId id, const uint16_t dst) {
+    const int  line  = ast.line(id);
+    const auto saved = layout.top;
+    // The callee's registers start right after the arguments' base, nothing live may sit above it
+    const auto base = dst != NO_REG && dst + 1u == layout.top && is_temporary(dst) ? dst : push();
+    expr(call.callee, base);
+    const auto args = ast.list(call.args);
+    const auto argc = static_cast<uint32_t>(args.size());
+    // Like the interpreter, the callee is checked before any argument is evaluated
+    emit(Op::CHECK_CALL, base, argc, 0, line);
+    for(const auto arg : args)
+        expr(arg, push());
+    emit(function && call.tail ? Op::TAIL_CALL : Op::CALL, base, argc, 0, line);
+    layout.top = saved;
+    if(dst != NO_REG && dst != base)
+        emit(Op::MOVE, dst, base);
+}
+
+void Compiler::hoisted(const Hoisted& hoisted, const uint16_t dst) {
+    const auto value = static_cast<uint16_t>(layout.hoisted(hoisted.coord));
+    const auto skip  = emit_bx(Op::JUMP_IF, value + 1u, 0);
+    expr(hoisted.expr, value);
+    emit_bx(Op::LOADK, value + 1u, constant(Literal{true}));
+    patch(skip, here());
+    if(dst != value)
+        emit(Op::MOVE, dst, value);
+}
+
+bool Compiler::assigns(const ExprId id) const {
+    return std::visit(
+        overloaded{
+            [](const Assign&) { return true; },
+            [this](const Binary& expr) { return assigns(expr.left) || assigns(expr.right); },
+            [this](const Logical& expr) { return assigns(expr.left) || assigns(expr.right); },
+            [this](const Unary& expr) { return assigns(expr.right); },
+            [this](const Grouping& expr) { return assigns(expr.expr); },
+            [this](const Call& expr) {
+                return assigns(expr.callee) || std::ranges::any_of(ast.list(expr.args), [this](const ExprId arg) {
+                           return assigns(arg);
+                       });
+            },
+            [this](const Inline& expr) { return assigns(expr.call); },
+            [this](const Hoisted& expr) { return assigns(expr.expr); },
+            // A lambda's body is a function of its own, it never sees the registers of this one
+            [](const auto&) { return false; },
+        },
+        ast.expr(id));
+}
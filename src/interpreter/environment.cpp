@@ -5,50 +5,77 @@
 
 #include <format>
 
-bool Environment::contains(const std::string& name) const {
+bool Environment::contains(const Symbol name) const {
     return variables.contains(name);
 }
 
-void Environment::define(const std::string& name, const Value& value) {
+void Environment::define(const Symbol name, const Value& value) {
     if(variables.contains(name))
         throw err::make(
             err::DUPLICATE_VAR,
-            std::format("variable/function '{}' already declared in this scope.", name),
+            std::format("variable/function '{}' already declared in this scope.", name.name()),
             -1);
-    variables[name] = value;
+    variables.emplace(name, value);
 }
 
-void Environment::define(const Token& name, const Value& value) {
-    if(variables.contains(name.lexeme))
+void Environment::define(const Name& name, const Value& value) {
+    if(name.slot != GLOBAL_SLOT) {
+        define(slots[name.slot], name, value);
+        return;
+    }
+    if(variables.contains(name.symbol))
         throw err::make(
             err::DUPLICATE_VAR,
-            std::format("variable/function '{}' already declared in this scope.", name.lexeme),
+            std::format("variable/function '{}' already declared in this scope.", name.symbol.name()),
             name.line);
-    variables[name.lexeme] = value;
+    variables.emplace(name.symbol, value);
 }
 
-Value Environment::get(std::string name) {
-    if(variables.contains(name))
-        return variables[name];
+void Environment::define(std::optional<Value>& slot, const Name& name, const Value& value) {
+    if(slot.has_value())
+        throw err::make(
+            err::DUPLICATE_VAR,
+            std::format("variable/function '{}' already declared in this scope.", name.symbol.name()),
+            name.line);
+    slot = value;
+}
+
+Value* Environment::find(const Symbol name) {
+    const auto it = variables.find(name);
+    return it != variables.end() ? &it->second : nullptr;
+}
+
+Value Environment::get(const Symbol name) {
+    if(const auto it = variables.find(name); it != variables.end())
+        return it->second;
     if(enclosing)
         return enclosing->get(name);
-    throw Error(err::UNDEFINED_VAR, std::format("Undefined variable '{}'.", name));
+    throw Error(err::UNDEFINED_VAR, std::format("Undefined variable '{}'.", name.name()));
 }
 
-void Environment::assign(std::string name, const Value& value) {
-    if(variables.contains(name)) {
-        variables[name] = value;
+void Environment::assign(const Symbol name, const Value& value) {
+    if(const auto it = variables.find(name); it != variables.end()) {
+        it->second = value;
         return;
     }
     if(enclosing) {
         enclosing->assign(name, value);
         return;
     }
-    throw Error(err::UNDEFINED_VAR, std::format("Undefined variable '{}'.", name));
+    throw Error(err::UNDEFINED_VAR, std::format("Undefined variable '{}'.", name.name()));
 }
 
-void Environment::remove(const std::string& name) {
-    if(variables.contains(name)) {
-        variables.erase(name);
-    }
-}
\ No newline at end of file
+void Environment::remove(const Symbol name) {
+    variables.erase(name);
+}
+
+std::optional<Value>& Environment::at(const Coord coord) {
+    Environment* scope = this;
+    for(uint32_t hop = 0; hop < coord.depth; hop++)
+        scope = scope->enclosing.get();
+    return scope->slots[coord.slot];
+}
+
+const std::shared_ptr<Environment>& Environment::parent() const {
+    return enclosing;
+}
@@ -0,0 +1,151 @@
+#include "interpreter/incremental.hpp"
+
+#include "interpreter/parser.hpp"
+#include "interpreter/scanner.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace {
+
+size_t offset_of(const std::string_view source, const Token& token) {
+    if(token.type == TokenType::END)
+        return source.size();
+    return static_cast<size_t>(token.lexeme.data() - source.data());
+}
+
+size_t hash_text(const std::string_view text) {
+    return std::hash<std::string_view>{}(text);
+}
+
+} // namespace
+
+IncrementalParser::EditStats IncrementalParser::update(const std::string_view source) {
+    const auto started = std::chrono::steady_clock::now();
+    auto       stats   = EditStats{};
+    if(source == text) {
+        stats.reused = declarations.size();
+        return stats;
+    }
+
+    if(ast->size() > 2 * live_nodes + COMPACT_SLACK) {
+        ast = std::make_shared<Ast>();
+        declarations.clear();
+        stats.compacted = true;
+    }
+
+    // The edit is whatever lies between the common prefix and the common suffix of the two versions
+    const size_t prefix = std::ranges::mismatch(text, source).in1 - text.begin();
+    size_t       suffix = 0;
+    while(suffix < std::min(text.size(), source.size()) - prefix &&
+          text[text.size() - 1 - suffix] == source[source.size() - 1 - suffix])
+        suffix++;
+    const size_t edit_end = source.size() - suffix;
+    const auto   shift    = static_cast<ptrdiff_t>(source.size()) - static_cast<ptrdiff_t>(text.size());
+
+    auto old = std::move(declarations);
+    declarations.clear();
+
+    // A declaration is kept when both it and the one after it, which holds its lookahead token, end before the edit
+    size_t keep = 0;
+    while(keep + 1 < old.size() && old[keep + 1].end <= prefix)
+        keep++;
+    declarations.assign(std::make_move_iterator(old.begin()), std::make_move_iterator(old.begin() + keep));
+    stats.reused = keep;
+
+    // Errors carry their line in the message, declarations after the last one with errors can move freely
+    size_t movable_from = 0;
+    for(size_t k = 0; k < old.size(); k++) {
+        if(!old[k].scan_errors.empty() || !old[k].parse_errors.empty())
+            movable_from = k + 1;
+    }
+
+    auto   scanner   = keep > 0 ? Scanner::from_source(source, old[keep].begin, old[keep].line)
+                                : Scanner::from_source(source);
+    auto   parser    = Parser::from_source(scanner, ast);
+    size_t cursor    = keep;
+    size_t scan_seen = 0;
+    while(!parser.is_end()) {
+        const size_t begin = offset_of(source, parser.peek());
+        const int    line  = parser.peek().line;
+
+        // Past the edit the tokens are the old ones, once a declaration starts where an old one did the rest is reused.
+        // Lexical errors met before the first token belong to the first declaration, so it is never a resync point,
+        // and neither is a token preceded by fresh lexical errors no reparsed declaration could own.
+        const bool owned = scanner.success() || scanner.collected_errors().size() == scan_seen;
+        if(begin >= edit_end && owned) {
+            cursor = std::max<size_t>(cursor, 1);
+            while(cursor < old.size() && static_cast<ptrdiff_t>(old[cursor].begin) + shift < static_cast<ptrdiff_t>(begin))
+                cursor++;
+            if(cursor < old.size() && static_cast<ptrdiff_t>(old[cursor].begin) + shift == static_cast<ptrdiff_t>(begin) &&
+               (line == old[cursor].line || cursor >= movable_from) &&
+               hash_text(source.substr(begin, old[cursor].end - old[cursor].begin)) == old[cursor].hash) {
+                const int lines = line - old[cursor].line;
+                for(auto it = old.begin() + cursor; it != old.end(); ++it) {
+                    it->begin += shift;
+                    it->end += shift;
+                    it->line += lines;
+                    if(lines != 0)
+                        ast->shift_lines(it->stmt, lines);
+                    declarations.push_back(std::move(*it));
+                    stats.reused++;
+                }
+                break;
+            }
+        }
+
+        const size_t nodes       = ast->size();
+        const size_t parse_seen  = parser.collected_errors().size();
+        const StmtId stmt        = parser.next_declaration();
+        const size_t end         = offset_of(source, parser.peek());
+        auto&        declaration = declarations.emplace_back(Declaration{
+                   .begin = begin,
+                   .end   = end,
+                   .hash  = hash_text(source.substr(begin, end - begin)),
+                   .line  = line,
+                   .stmt  = stmt,
+                   .nodes = ast->size() - nodes,
+        });
+        // Lexical errors met while pulling the token after the declaration are charged to it as well
+        if(!scanner.success()) {
+            const auto errors = scanner.collected_errors();
+            declaration.scan_errors.assign(errors.begin() + static_cast<ptrdiff_t>(scan_seen), errors.end());
+            scan_seen = errors.size();
+        }
+        const auto& errors = parser.collected_errors();
+        declaration.parse_errors.assign(errors.begin() + static_cast<ptrdiff_t>(parse_seen), errors.end());
+        stats.reparsed++;
+    }
+
+    // A source without any declaration can still hold lexical errors
+    if(declarations.empty() && !scanner.success())
+        declarations.push_back(Declaration{.end = source.size(), .scan_errors = scanner.collected_errors()});
+
+    text.assign(source);
+    live_nodes = 0;
+    for(const auto& declaration : declarations)
+        live_nodes += declaration.nodes;
+    stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    return stats;
+}
+
+Program IncrementalParser::program() const {
+    auto program = Program{.ast = ast};
+    for(const auto& declaration : declarations) {
+        if(declaration.stmt != StmtId::NONE)
+            program.statements.push_back(declaration.stmt);
+    }
+    return program;
+}
+
+std::vector<Error> IncrementalParser::collected_errors() const {
+    std::vector<Error> errors;
+    for(const auto& declaration : declarations)
+        errors.insert(errors.end(), declaration.scan_errors.begin(), declaration.scan_errors.end());
+    if(!errors.empty())
+        return errors;
+    for(const auto& declaration : declarations)
+        errors.insert(errors.end(), declaration.parse_errors.begin(), declaration.parse_errors.end());
+    return errors;
+}
@@ -0,0 +1,250 @@
+#include "interpreter/inliner.hpp"
+
+#include "interpreter/parser.hpp"
+#include "utils/templ.hpp"
+
+#include <algorithm>
+
+size_t Inliner::inline_calls(const Program& program) {
+    for(const auto stmt : program.statements) {
+        const auto* decl = std::get_if<FuncDeclStmt>(&program.ast->stmt(stmt));
+        // A second declaration of a name fails when it runs, the global keeps the first one
+        if(!decl || by_name.contains(decl->name.symbol))
+            continue;
+        by_name.emplace(decl->name.symbol, static_cast<uint32_t>(targets.size()));
+        targets.push_back({.ast = program.ast, .params = decl->params, .body = decl->body, .name = decl->name.symbol});
+    }
+
+    const size_t before = inlined;
+    ast                 = program.ast.get();
+    rewrite(program.statements);
+    ast = nullptr;
+    return inlined - before;
+}
+
+void Inliner::inline_calls(Ast& code, const std::span<const StmtId> statements) {
+    ast = &code;
+    rewrite(statements);
+    ast = nullptr;
+}
+
+bool Inliner::matches(const uint32_t target, const Ast* code, const BodyId body) const {
+    return targets[target].ast.get() == code && targets[target].body == body;
+}
+
+bool Inliner::inlinable(Target& target) {
+    if(target.state != State::UNCHECKED)
+        return target.state == State::INLINABLE;
+    target.state = State::REJECTED;
+    if(limit == 0)
+        return false;
+
+    const auto params = target.ast->list(target.params);
+    for(size_t k = 0; k < params.size(); k++) {
+        if(std::ranges::any_of(params.subspan(k + 1), [&](const Name& name) { return name.symbol == params[k].symbol; }))
+            return false;
+    }
+
+    // Deciding needs the body, a deferred one is parsed now rather than on its first call
+    const auto [code, statements] = Parser::function_body(*target.ast, target.body);
+    auto expr                     = ExprId::NONE;
+    if(statements.size() > 1)
+        return false;
+    if(statements.size() == 1) {
+        if(const auto* stmt = std::get_if<ExprStmt>(&code->stmt(statements.front())))
+            expr = stmt->expr;
+        else if(const auto* ret = std::get_if<ReturnStmt>(&code->stmt(statements.front())))
+            expr = ret->value;
+        else
+            return false;
+    }
+    size_t nodes = 0;
+    if(expr != ExprId::NONE && !is_small(target, *code, expr, nodes))
+        return false;
+
+    target.code  = code;
+    target.expr  = expr;
+    target.state = State::INLINABLE;
+    return true;
+}
+
+bool Inliner::is_small(const Target& target, const Ast& code, const ExprId expr, size_t& nodes) const {
+    if(++nodes > limit)
+        return false;
+    return std::visit(
+        overloaded{
+            [](const Literal&) { return true; },
+            [](const Variable&) { return true; },
+            [&](const Binary& node) {
+                return is_small(target, code, node.left, nodes) && is_small(target, code, node.right, nodes);
+            },
+            [&](const Logical& node) {
+                return is_small(target, code, node.left, nodes) && is_small(target, code, node.right, nodes);
+            },
+            [&](const Unary& node) { return is_small(target, code, node.right, nodes); },
+            [&](const Grouping& node) { return is_small(target, code, node.expr, nodes); },
+            [&](const Call& node) {
+                if(const auto* callee = std::get_if<Variable>(&code.expr(node.callee)); callee && callee->name == target.name)
+                    return false;
+                return is_small(target, code, node.callee, nodes) &&
+                       std::ranges::all_of(code.list(node.args), [&](const ExprId arg) {
+                           return is_small(target, code, arg, nodes);
+                       });
+            },
+            // A body that already ran had its own calls inlined, the original call is what it says
+            [&](const Inline& node) { return is_small(target, code, node.call, nodes); },
+            // Assignments, closures and declarations need the environment a call would have created
+            [](const auto&) { return false; },
+        },
+        code.expr(expr));
+}
+
+void Inliner::rewrite(const std::span<const StmtId> statements) {
+    for(const auto stmt : statements)
+        rewrite(stmt);
+}
+
+void Inliner::rewrite(const StmtId id) {
+    if(id == StmtId::NONE)
+        return;
+    // Statements are never added, references to them stay valid while expressions are substituted
+    std::visit(
+        overloaded{
+            [this](ExprStmt& stmt) { stmt.expr = rewrite(stmt.expr); },
+            [this](IfStmt& stmt) {
+                stmt.condition = rewrite(stmt.condition);
+                rewrite(stmt.then_branch);
+                rewrite(stmt.else_branch);
+            },
+            [this](VarDeclStmt& stmt) { stmt.initializer = rewrite(stmt.initializer); },
+            [this](const FuncDeclStmt& stmt) { rewrite(stmt.body); },
+            [this](const BlockStmt& stmt) { rewrite(ast->list(stmt.statements)); },
+            [this](WhileStmt& stmt) {
+                stmt.condition = rewrite(stmt.condition);
+                rewrite(stmt.body);
+            },
+            [this](ReturnStmt& stmt) { stmt.value = rewrite(stmt.value); },
+            [](const auto&) {},
+        },
+        ast->stmt(id));
+}
+
+void Inliner::rewrite(const BodyId id) {
+    // A deferred body is rewritten once it is parsed, on its first call
+    if(const auto& body = ast->body(id); !body.deferred && !body.ast)
+        rewrite(ast->list(body.statements));
+}
+
+ExprId Inliner::rewrite(const ExprId id) {
+    if(id == ExprId::NONE)
+        return id;
+    // Substituting adds expressions, the node is updated through a copy rather than a reference into the arena
+    auto node = ast->expr(id);
+    std::visit(
+        overloaded{
+            [this](Binary& expr) {
+                expr.left  = rewrite(expr.left);
+                expr.right = rewrite(expr.right);
+            },
+            [this](Logical& expr) {
+                expr.left  = rewrite(expr.left);
+                expr.right = rewrite(expr.right);
+            },
+            [this](Unary& expr) { expr.right = rewrite(expr.right); },
+            [this](Grouping& expr) { expr.expr = rewrite(expr.expr); },
+            [this](Assign& expr) { expr.value = rewrite(expr.value); },
+            [this](Call& expr) {
+                expr.callee = rewrite(expr.callee);
+                for(uint32_t k = 0; k < expr.args.size; k++) {
+                    const auto arg          = rewrite(ast->list(expr.args)[k]);
+                    ast->list(expr.args)[k] = arg;
+                }
+            },
+            [this](const Lambda& expr) { rewrite(expr.body); },
+            [](const auto&) {},
+        },
+        node);
+    ast->expr(id) = node;
+    return std::holds_alternative<Call>(node) ? substitute(id) : id;
+}
+
+ExprId Inliner::substitute(const ExprId id) {
+    const auto  call   = std::get<Call>(ast->expr(id));
+    const auto* callee = std::get_if<Variable>(&ast->expr(call.callee));
+    // Only a global can hold the top level function, a local of the same name hides it
+    if(!callee || callee->coords.size != 0)
+        return id;
+    const auto it = by_name.find(callee->name);
+    if(it == by_name.end())
+        return id;
+
+    const uint32_t index  = it->second;
+    auto&          target = targets[index];
+    // A call with the wrong arity is left to fail, and a function is never substituted inside itself
+    if(target.params.size != call.args.size || std::ranges::find(inlining, index) != inlining.end() || !inlinable(target))
+        return id;
+
+    inlining.push_back(index);
+    const auto body = target.expr == ExprId::NONE ? ast->add(Literal(nullptr), ast->line(id))
+                                                  : copy(target, target.expr, call.tail);
+    inlining.pop_back();
+    inlined++;
+    return ast->add(Inline{id, body, index}, ast->line(id));
+}
+
+ExprId Inliner::copy(const Target& target, const ExprId id, const bool tail) {
+    // The body may live in the arena it is copied into, nothing is read from it by reference across an add.
+    // A copied call is in tail position when the substituted call was and the call ends the body.
+    const Ast& from = *target.code;
+    const int  line = from.line(id);
+    auto       node = from.expr(id);
+    return std::visit<ExprId>(
+        overloaded{
+            [&](Literal& expr) {
+                if(const auto* string = std::get_if<StringId>(&expr); string && &from != ast)
+                    expr = ast->add_string(from.string(*string));
+                return ast->add(expr, line);
+            },
+            [&](const Variable& expr) {
+                const auto params = target.ast->list(target.params);
+                const auto param  = std::ranges::find(params, expr.name, &Name::symbol);
+                if(param != params.end())
+                    return ast->add(Param{static_cast<uint32_t>(param - params.begin())}, line);
+                // Anything else the body names is a global, whatever the call site has in scope
+                return ast->add(Variable{expr.name}, line);
+            },
+            [&](Binary& expr) {
+                // The copy sees operands of its own, it specializes on them
+                expr.left           = copy(target, expr.left, false);
+                expr.right          = copy(target, expr.right, false);
+                expr.specialization = Specialization::UNSEEN;
+                return ast->add(expr, line);
+            },
+            [&](Logical& expr) {
+                expr.left  = copy(target, expr.left, false);
+                expr.right = copy(target, expr.right, tail);
+                return ast->add(expr, line);
+            },
+            [&](Unary& expr) {
+                expr.right = copy(target, expr.right, false);
+                return ast->add(expr, line);
+            },
+            [&](Grouping& expr) {
+                expr.expr = copy(target, expr.expr, tail);
+                return ast->add(expr, line);
+            },
+            [&](Call& expr) {
+                std::vector<ExprId> args;
+                expr.callee = copy(target, expr.callee, false);
+                for(uint32_t k = 0; k < expr.args.size; k++)
+                    args.push_back(copy(target, from.list(expr.args)[k], false));
+                expr.args = ast->add_list(std::span<const ExprId>(args));
+                expr.tail = tail;
+                // Calls in the substituted body are inlined in turn
+                return substitute(ast->add(expr, line));
+            },
+            [&](const Inline& expr) { return copy(target, expr.call, tail); },
+            [&](const auto&) { return ast->add(node, line); },
+        },
+        node);
+}
@@ -1,8 +1,12 @@
 #include "interpreter/interpreter.hpp"
 
 #include "const/prelude_func.hpp"
+#include "interpreter/jit.hpp"
+#include "interpreter/optimizer.hpp"
+#include "interpreter/resolver.hpp"
 #include "types/error_code.hpp"
 #include "utils/errorx.hpp"
+#include "utils/number.hpp"
 #include "utils/templ.hpp"
 #include "utils/to_string.hpp"
 
@@ -11,6 +15,7 @@
 #include <memory>
 #include <cmath>
 #include <format>
+#include <utility>
 
 void Interpreter::panic(const int err_code, const std::string& message, const int line) {
     throw err::make(err_code, message, line);
@@ -35,62 +40,172 @@ void Interpreter::prelude() const {
                             if(input == "false") {
                                 return ExecSig{.value = Value(false)};
                             }
-                            try {
-                                size_t pos;
-                                double num = std::stod(input, &pos);
-                                if(pos == input.length()) {
-                                    return ExecSig{.value = Value(num)};
-                                }
-                            } catch(...) {
-                                // Not a number, fall through
+                            if(const auto num = utils::parse_number(input)) {
+                                return ExecSig{.value = Value(*num)};
                             }
                             return ExecSig{.value = Value(input)};
                         }};
-    global_env->define(prelude::NOW, Value(std::make_shared<NativeFunc>(now_func)));
-    global_env->define(prelude::PUT, Value(std::make_shared<NativeFunc>(put_func)));
-    global_env->define(prelude::GET, Value(std::make_shared<NativeFunc>(get_func)));
+    global_env->define(Symbol::intern(prelude::NOW), Value(std::make_shared<NativeFunc>(now_func)));
+    global_env->define(Symbol::intern(prelude::PUT), Value(std::make_shared<NativeFunc>(put_func)));
+    global_env->define(Symbol::intern(prelude::GET), Value(std::make_shared<NativeFunc>(get_func)));
 }
 
 void Interpreter::exclude_native_func(const std::vector<std::string>& list) const {
     for(auto const& name : list)
-        global_env->remove(name);
+        global_env->remove(Symbol::intern(name));
 }
 
 bool Interpreter::is_truthy(const Value& value) {
-    if(std::holds_alternative<bool>(value))
-        return std::get<bool>(value);
-    if(std::holds_alternative<std::nullptr_t>(value))
-        return false;
-    return true;
+    if(value.is_bool())
+        return value.as_bool();
+    return !value.is_nil();
 }
 
 bool Interpreter::is_equal(const Value& left, const Value& right) {
-    if(std::holds_alternative<std::nullptr_t>(left) && std::holds_alternative<std::nullptr_t>(right))
-        return true;
-    if(std::holds_alternative<std::nullptr_t>(left) || std::holds_alternative<std::nullptr_t>(right))
-        return false;
-    return left == right;
+    if(left.is_number() && right.is_number())
+        return left.as_number() == right.as_number();
+    if(left.is_string() && right.is_string())
+        return Value::equal_strings(left, right);
+    if(left.is_callable() && right.is_callable())
+        return left.as_callable() == right.as_callable();
+    // nil and booleans are boxed with their value, equal ones are identical
+    return left.is_identical(right);
 }
 
 bool Interpreter::is_num_operand(const Value& operand) {
-    return std::holds_alternative<double>(operand);
+    return operand.is_number();
 }
 
-void Interpreter::ensure_num_operands(const Token& op, const std::vector<Value>& operands) {
-    for(const auto& operand : operands) {
-        if(!is_num_operand(operand))
-            panic(err::OPERAND_INVALID, "Operand must be a number.", op.line);
-    }
+void Interpreter::ensure_num_operands(const int line, const Value& operand) {
+    if(!is_num_operand(operand))
+        panic(err::OPERAND_INVALID, "Operand must be a number.", line);
+}
+
+void Interpreter::ensure_num_operands(const int line, const Value& left, const Value& right) {
+    ensure_num_operands(line, left);
+    ensure_num_operands(line, right);
 }
 
-ExecSig Interpreter::interpret(const std::vector<Stmt>& statements) {
+ExecSig Interpreter::interpret(const Program& program) {
+    ast = program.ast.get();
+    // A runtime error leaves the environment of the statement that failed, the next REPL line starts over
+    env         = global_env;
+    in_scope    = 0;
+    inline_base = 0;
+    tail_callee = nullptr;
+    stack.clear();
+    frames.clear();
+    inline_args.clear();
     auto res = ExecSig{};
-    for(const auto& stmt : statements)
+    for(const auto stmt : program.statements)
         res = run(stmt);
     return res;
 }
 
-ExecSig Interpreter::run(const Stmt& stmt) {
+const std::shared_ptr<Environment>& Interpreter::globals() const {
+    return global_env;
+}
+
+void Interpreter::use_jit(Jit* jit) {
+    this->jit = jit;
+}
+
+size_t Interpreter::inline_calls(const Program& program) {
+    return inliner.inline_calls(program);
+}
+
+ResolvedBody Interpreter::function_body(const Ast& code, const BodyId id) {
+    const auto& body = code.body(id);
+    if(!body.resolved) {
+        // Only deferred bodies are left unresolved, they always get an arena of their own
+        Parser::function_body(code, id);
+        Optimizer::optimize(*body.ast, body.statements);
+        Resolver::resolve(body);
+        inliner.inline_calls(*body.ast, body.ast->list(body.statements));
+    }
+    const Ast& owner = body.ast ? *body.ast : code;
+    return {owner, owner.list(body.statements), body.slots, body.captured};
+}
+
+ExecSig Interpreter::call(const Func& func, std::vector<Value> arguments) {
+    // Holds the function the previous iteration tail called, nothing else may own it anymore
+    std::shared_ptr<Callable> callee;
+    const Func*               current = &func;
+    // The caller's frames are not in the scope of the function called, its closure is
+    const auto caller_frames = std::exchange(in_scope, 0);
+    while(true) {
+        if(jit) {
+            if(const auto value = jit->call(*current, arguments)) {
+                in_scope = caller_frames;
+                return ExecSig{.value = *value};
+            }
+        }
+        const auto [code, statements, slots, captured] = function_body(*current->ast, current->body);
+        const auto names                               = current->ast->list(current->params);
+        auto       res                                 = ExecSig{};
+        if(captured) {
+            const auto function_env = std::make_shared<Environment>(current->closure, slots);
+            for(size_t i = 0; i < names.size(); ++i) {
+                function_env->define(names[i], arguments[i]);
+            }
+            res = executeBlock(code, statements, function_env);
+        } else {
+            const auto current_env = std::exchange(env, current->closure);
+            const auto current_ast = std::exchange(ast, &code);
+            push_frame(slots);
+            for(size_t i = 0; i < names.size(); ++i) {
+                define(names[i], arguments[i]);
+            }
+            res = execute(statements);
+            pop_frame();
+            ast = current_ast;
+            env = current_env;
+        }
+        if(!tail_callee) {
+            in_scope = caller_frames;
+            return res;
+        }
+        callee    = std::move(tail_callee);
+        arguments = std::move(tail_args);
+        current   = static_cast<const Func*>(callee.get());
+    }
+}
+
+void Interpreter::push_frame(const uint32_t slots) {
+    frames.push_back(static_cast<uint32_t>(stack.size()));
+    stack.resize(stack.size() + slots);
+    in_scope++;
+}
+
+void Interpreter::pop_frame() {
+    stack.resize(frames.back());
+    frames.pop_back();
+    in_scope--;
+}
+
+std::optional<Value>& Interpreter::slot(const Coord coord) {
+    if(coord.depth < in_scope)
+        return stack[frames[frames.size() - 1 - coord.depth] + coord.slot];
+    return env->at({coord.depth - in_scope, coord.slot});
+}
+
+Value* Interpreter::find(const std::span<const Coord> coords) {
+    for(const auto coord : coords) {
+        if(auto& value = slot(coord))
+            return &*value;
+    }
+    return nullptr;
+}
+
+void Interpreter::define(const Name& name, const Value& value) {
+    // The innermost scope is the last frame when there is one, frames are always inside heap environments
+    if(in_scope == 0)
+        env->define(name, value);
+    else
+        Environment::define(stack[frames.back() + name.slot], name, value);
+}
+
+ExecSig Interpreter::run(const StmtId stmt) {
     return std::visit<ExecSig>(
         overloaded{
             [this](const ExprStmt& expr_stmt) { return runExprStmt(expr_stmt); },
@@ -103,7 +218,7 @@ ExecSig Interpreter::run(const Stmt& stmt) {
             [this](const ContinueStmt) { return runContinueStmt(); },
             [this](const ReturnStmt& return_stmt) { return runReturnStmt(return_stmt); },
         },
-        stmt);
+        ast->stmt(stmt));
 }
 
 ExecSig Interpreter::runExprStmt(const ExprStmt& stmt) {
@@ -113,54 +228,96 @@ ExecSig Interpreter::runExprStmt(const ExprStmt& stmt) {
 ExecSig Interpreter::runIfStmt(const IfStmt& stmt) {
     auto res = ExecSig{};
     if(is_truthy(evaluate(stmt.condition)))
-        res = run(*stmt.then_branch);
-    else if(stmt.else_branch)
-        res = run(*stmt.else_branch);
+        res = run(stmt.then_branch);
+    else if(stmt.else_branch != StmtId::NONE)
+        res = run(stmt.else_branch);
     return res;
 }
 
 ExecSig Interpreter::runVarDeclStmt(const VarDeclStmt& stmt) {
     Value value = nullptr;
-    if(stmt.initializer)
+    if(stmt.initializer != ExprId::NONE)
         value = evaluate(stmt.initializer);
 
-    env->define(stmt.name, value);
+    define(stmt.name, value);
     return ExecSig{.value = value};
 }
 
 ExecSig Interpreter::runFuncDeclStmt(const FuncDeclStmt& stmt) {
-    const auto func = std::make_shared<Func>(stmt.params, stmt.body, env, stmt.name.lexeme);
-    env->define(stmt.name, Value(func));
+    // The resolver gave every scope a closure is created in a heap environment, `env` is the innermost
+    const auto func = std::make_shared<Func>(ast->shared_from_this(), stmt.params, stmt.body, env, stmt.name.symbol);
+    define(stmt.name, Value(func));
     return ExecSig{};
 }
 
 ExecSig Interpreter::runBlockStmt(const BlockStmt& stmt) {
-    return executeBlock(stmt.statements, std::make_shared<Environment>(Environment{env}));
+    if(!stmt.captured)
+        return executeFrame(ast->list(stmt.statements), stmt.slots);
+    return executeBlock(ast->list(stmt.statements), std::make_shared<Environment>(env, stmt.slots));
+}
+
+ExecSig Interpreter::executeBlock(
+    const Ast&                          code,
+    const std::span<const StmtId>       statements,
+    const std::shared_ptr<Environment>& environment) {
+    const auto current_ast = std::exchange(ast, &code);
+    auto       res         = executeBlock(statements, environment);
+    ast                    = current_ast;
+    return res;
 }
 
 ExecSig Interpreter::executeBlock(
-    const std::vector<std::shared_ptr<Stmt>>& statements,
-    const std::shared_ptr<Environment>&       environment) {
+    const std::span<const StmtId>       statements,
+    const std::shared_ptr<Environment>& environment) {
 
     const auto current_env = env;
     env                    = environment;
-    auto res               = ExecSig{};
-    for(const auto& stmt : statements) {
-        res = run(*stmt);
+    auto res               = execute(statements);
+    env                    = current_env;
+    return res;
+}
+
+ExecSig Interpreter::executeFrame(const std::span<const StmtId> statements, const uint32_t slots) {
+    push_frame(slots);
+    auto res = execute(statements);
+    pop_frame();
+    return res;
+}
+
+ExecSig Interpreter::execute(const std::span<const StmtId> statements) {
+    auto res = ExecSig{};
+    for(const auto stmt : statements) {
+        res = run(stmt);
         // handle case break/continue/return nested in block
         if(res.control == ExecControl::BREAK || res.control == ExecControl::CONTINUE ||
            res.control == ExecControl::RETURN) {
             break;
         }
     }
-    env = current_env;
     return res;
 }
 
 ExecSig Interpreter::runWhileStmt(const WhileStmt& stmt) {
+    if(stmt.hoisted.size == 0)
+        return runLoop(stmt);
+    // Values hoisted out of the loop are kept for one run of it, each entry starts with empty slots
+    if(!stmt.captured) {
+        push_frame(stmt.hoisted.size);
+        auto res = runLoop(stmt);
+        pop_frame();
+        return res;
+    }
+    const auto current_env = env;
+    env                    = std::make_shared<Environment>(env, stmt.hoisted.size);
+    auto res               = runLoop(stmt);
+    env                    = current_env;
+    return res;
+}
+
+ExecSig Interpreter::runLoop(const WhileStmt& stmt) {
     auto result = ExecSig{};
     while(is_truthy(evaluate(stmt.condition))) {
-        auto res = run(*stmt.body);
+        auto res = run(stmt.body);
         if(res.control == ExecControl::BREAK) {
             break;
         }
@@ -185,39 +342,52 @@ ExecSig Interpreter::runContinueStmt() {
 
 ExecSig Interpreter::runReturnStmt(const ReturnStmt& stmt) {
     Value value = nullptr;
-    if(stmt.value)
+    if(stmt.value != ExprId::NONE)
         value = evaluate(stmt.value);
     return ExecSig{ExecControl::RETURN, value};
 }
 
-Value Interpreter::evaluate(const std::shared_ptr<Expr>& expr) {
+Value Interpreter::evaluate(const ExprId expr) {
     return std::visit<Value>(
         overloaded{
-            [this](const Binary& binary) { return evaluateBinaryExpr(binary); },
+            [this, expr](const Binary& binary) { return evaluateBinaryExpr(binary, expr); },
             [this](const Grouping& grouping) { return evaluateGroupingExpr(grouping); },
             [this](const Literal& literal) { return evaluateLiteralExpr(literal); },
-            [this](const Unary& unary) { return evaluateUnaryExpr(unary); },
+            [this, expr](const Unary& unary) { return evaluateUnaryExpr(unary, expr); },
             [this](const Variable& variable) { return evaluateVariableExpr(variable); },
             [this](const Assign& assign) { return evaluateAssignExpr(assign); },
             [this](const Logical& logical) { return evaluateLogicalExpr(logical); },
-            [this](const Call& call) { return evaluateCallExpr(call); },
+            [this, expr](const Call& call) { return evaluateCallExpr(call, expr); },
             [this](const Lambda& lambda) { return evaluateLambdaExpr(lambda); },
+            [this](const Inline& inlined) { return evaluateInlineExpr(inlined); },
+            [this](const Param& param) { return inline_args[inline_base + param.index]; },
+            [this](const Hoisted& hoisted) { return evaluateHoistedExpr(hoisted); },
         },
-        *expr);
+        ast->expr(expr));
 }
 
-Value Interpreter::evaluateVariableExpr(const Variable& variable) const {
-    return env->get(variable.name.lexeme);
+Value Interpreter::evaluateVariableExpr(const Variable& variable) {
+    if(const auto* value = find(ast->list(variable.coords)))
+        return *value;
+    return global_env->get(variable.name);
 }
 
 Value Interpreter::evaluateAssignExpr(const Assign& assign) {
     const Value value = evaluate(assign.value);
-    env->assign(assign.name.lexeme, value);
+    if(auto* slot = find(ast->list(assign.coords)))
+        *slot = value;
+    else
+        global_env->assign(assign.name, value);
     return value;
 }
 
-Value Interpreter::evaluateLiteralExpr(const Literal& literal) {
-    return std::visit([](const auto& val) -> Value { return Value(val); }, literal);
+Value Interpreter::evaluateLiteralExpr(const Literal& literal) const {
+    return std::visit(
+        overloaded{
+            [this](const StringId string) { return ast->string_value(string); },
+            [](const auto& val) { return Value(val); },
+        },
+        literal);
 }
 
 Value Interpreter::evaluateGroupingExpr(const Grouping& group) {
@@ -227,7 +397,7 @@ Value Interpreter::evaluateGroupingExpr(const Grouping& group) {
 Value Interpreter::evaluateLogicalExpr(const Logical& logical) {
     Value left = evaluate(logical.left);
     // short-circuiting
-    if(logical.op.type == TokenType::OR) {
+    if(logical.op == LogicalOp::OR) {
         if(is_truthy(left))
             return left;
     } else {
@@ -237,38 +407,75 @@ Value Interpreter::evaluateLogicalExpr(const Logical& logical) {
     return evaluate(logical.right);
 }
 
-Value Interpreter::evaluateCallExpr(const Call& call) {
+Value Interpreter::evaluateCallExpr(const Call& call, const ExprId expr) {
     const Value callee = evaluate(call.callee);
-    if(!std::holds_alternative<std::shared_ptr<Callable>>(callee))
-        panic(err::NOT_CALLABLE, "Can only call functions.", call.paren.line);
+    if(!callee.is_callable())
+        panic(err::NOT_CALLABLE, "Can only call functions.", ast->line(expr));
 
-    auto& callable = std::get<std::shared_ptr<Callable>>(callee);
-    if(call.args.size() != callable->arity())
+    const auto& callable = callee.as_callable();
+    if(call.args.size != callable->arity())
         panic(
             err::ARGUMENT_COUNT_MISMATCH,
-            std::format("Expected {} arguments but got {}.", callable->arity(), call.args.size()),
-            call.paren.line);
+            std::format("Expected {} arguments but got {}.", callable->arity(), call.args.size),
+            ast->line(expr));
 
     std::vector<Value> arguments;
-    for(const auto& arg : call.args)
+    for(const auto arg : ast->list(call.args))
         arguments.push_back(evaluate(arg));
 
+    // Nothing is left to do with the value of a tail call, the function it ends returns and makes it instead
+    if(call.tail && dynamic_cast<const Func*>(callable.get())) {
+        tail_callee = callable;
+        tail_args   = std::move(arguments);
+        return nullptr;
+    }
     return callable->call(*this, arguments).value;
 }
 
 Value Interpreter::evaluateLambdaExpr(const Lambda& lambda) const {
-    return std::make_shared<LambdaFunc>(LambdaFunc{lambda.params, lambda.body, env});
+    // Created in captured scopes only, all of them heap environments with `env` the innermost
+    return std::make_shared<LambdaFunc>(LambdaFunc{ast->shared_from_this(), lambda.params, lambda.body, env});
+}
+
+Value Interpreter::evaluateInlineExpr(const Inline& inlined) {
+    const auto& call   = std::get<Call>(ast->expr(inlined.call));
+    const Value callee = evaluate(call.callee);
+    const auto* func   = callee.is_callable() ? dynamic_cast<const Func*>(callee.as_callable().get()) : nullptr;
+    if(!func || !inliner.matches(inlined.target, func->ast.get(), func->body))
+        return evaluateCallExpr(call, inlined.call);
+
+    // Same order as a call: the callee, then every argument, then the body
+    const size_t base = inline_args.size();
+    for(const auto arg : ast->list(call.args))
+        inline_args.push_back(evaluate(arg));
+    const auto  frame = std::exchange(inline_base, base);
+    const Value value = evaluate(inlined.body);
+    inline_base       = frame;
+    inline_args.resize(base);
+    return value;
 }
 
-Value Interpreter::evaluateUnaryExpr(const Unary& unary) {
+Value Interpreter::evaluateHoistedExpr(const Hoisted& hoisted) {
+    if(const auto& value = slot(hoisted.coord))
+        return *value;
+    // Evaluating may push frames and move the stack, the slot is looked up again once it is done
+    const Value value   = evaluate(hoisted.expr);
+    slot(hoisted.coord) = value;
+    return value;
+}
+
+Value Interpreter::evaluateUnaryExpr(const Unary& unary, const ExprId expr) {
     const Value right = evaluate(unary.right);
+    return Interpreter::unary(unary.op, right, ast->line(expr));
+}
 
-    switch(unary.op.type) {
-    case TokenType::MINUS:
-        ensure_num_operands(unary.op, {right});
-        return -std::get<double>(right);
+Value Interpreter::unary(const UnaryOp op, const Value& right, const int line) {
+    switch(op) {
+    case UnaryOp::NEGATE:
+        ensure_num_operands(line, right);
+        return -right.as_number();
 
-    case TokenType::BANG:
+    case UnaryOp::NOT:
         return !is_truthy(right);
 
     default:
@@ -276,51 +483,155 @@ Value Interpreter::evaluateUnaryExpr(const Unary& unary) {
     }
 }
 
-Value Interpreter::evaluateBinaryExpr(const Binary& binary) {
+Value Interpreter::evaluateBinaryExpr(const Binary& binary, const ExprId expr) {
     const Value left  = evaluate(binary.left);
     const Value right = evaluate(binary.right);
-    switch(binary.op.type) {
-    case TokenType::MINUS:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) - std::get<double>(right);
 
-    case TokenType::SLASH:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) / std::get<double>(right);
+    const bool   numbers = left.is_number() && right.is_number();
+    const double l       = left.as_number();
+    const double r       = right.as_number();
+    // Each specialized form only guards its operand types, a failed guard falls through to the generic operator
+    switch(binary.specialization) {
+    case Specialization::ADD_NUM:
+        if(numbers)
+            return l + r;
+        break;
+    case Specialization::SUBTRACT_NUM:
+        if(numbers)
+            return l - r;
+        break;
+    case Specialization::MULTIPLY_NUM:
+        if(numbers)
+            return l * r;
+        break;
+    case Specialization::DIVIDE_NUM:
+        if(numbers)
+            return l / r;
+        break;
+    case Specialization::MODULO_NUM:
+        if(numbers)
+            return std::fmod(l, r);
+        break;
+    case Specialization::GREATER_NUM:
+        if(numbers)
+            return l > r;
+        break;
+    case Specialization::GREATER_EQUAL_NUM:
+        if(numbers)
+            return l >= r;
+        break;
+    case Specialization::LESS_NUM:
+        if(numbers)
+            return l < r;
+        break;
+    case Specialization::LESS_EQUAL_NUM:
+        if(numbers)
+            return l <= r;
+        break;
+    case Specialization::EQUAL_NUM:
+        if(numbers)
+            return l == r;
+        break;
+    case Specialization::NOT_EQUAL_NUM:
+        if(numbers)
+            return l != r;
+        break;
+    case Specialization::CONCAT_STR: {
+        if(left.is_string() && right.is_string())
+            return Value::concat(left, right);
+        break;
+    }
+    case Specialization::UNSEEN:
+        binary.specialization = specialize(binary.op, left, right);
+        return Interpreter::binary(binary.op, left, right, ast->line(expr));
+    case Specialization::GENERIC:
+        return Interpreter::binary(binary.op, left, right, ast->line(expr));
+    }
+    binary.specialization = Specialization::GENERIC;
+    return Interpreter::binary(binary.op, left, right, ast->line(expr));
+}
+
+Specialization Interpreter::specialize(const BinaryOp op, const Value& left, const Value& right) {
+    if(is_num_operand(left) && is_num_operand(right)) {
+        switch(op) {
+        case BinaryOp::ADD:
+            return Specialization::ADD_NUM;
+        case BinaryOp::SUBTRACT:
+            return Specialization::SUBTRACT_NUM;
+        case BinaryOp::MULTIPLY:
+            return Specialization::MULTIPLY_NUM;
+        case BinaryOp::DIVIDE:
+            return Specialization::DIVIDE_NUM;
+        case BinaryOp::MODULO:
+            return Specialization::MODULO_NUM;
+        case BinaryOp::GREATER:
+            return Specialization::GREATER_NUM;
+        case BinaryOp::GREATER_EQUAL:
+            return Specialization::GREATER_EQUAL_NUM;
+        case BinaryOp::LESS:
+            return Specialization::LESS_NUM;
+        case BinaryOp::LESS_EQUAL:
+            return Specialization::LESS_EQUAL_NUM;
+        case BinaryOp::EQUAL:
+            return Specialization::EQUAL_NUM;
+        case BinaryOp::NOT_EQUAL:
+            return Specialization::NOT_EQUAL_NUM;
+        }
+    }
+    const bool strings = left.is_string() && right.is_string();
+    if(strings && op == BinaryOp::ADD)
+        return Specialization::CONCAT_STR;
+    // Mixed operands, or ones the operator rejects and reports, stay on the generic path
+    return Specialization::GENERIC;
+}
+
+Value Interpreter::binary(const BinaryOp op, const Value& left, const Value& right, const int line) {
+    switch(op) {
+    case BinaryOp::SUBTRACT:
+        ensure_num_operands(line, left, right);
+        return left.as_number() - right.as_number();
 
-    case TokenType::STAR:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) * std::get<double>(right);
+    case BinaryOp::DIVIDE:
+        ensure_num_operands(line, left, right);
+        return left.as_number() / right.as_number();
 
-    case TokenType::PERCENT:
-        ensure_num_operands(binary.op, {left, right});
-        return std::fmod(std::get<double>(left), std::get<double>(right));
+    case BinaryOp::MULTIPLY:
+        ensure_num_operands(line, left, right);
+        return left.as_number() * right.as_number();
 
-    case TokenType::PLUS:
+    case BinaryOp::MODULO:
+        ensure_num_operands(line, left, right);
+        return std::fmod(left.as_number(), right.as_number());
+
+    case BinaryOp::ADD: {
         if(is_num_operand(left) && is_num_operand(right))
-            return std::get<double>(left) + std::get<double>(right);
-        return utils::to_string(left) + utils::to_string(right);
+            return left.as_number() + right.as_number();
+        // Strings are joined without copying their text, other operands are converted first
+        return Value::concat(
+            left.is_string() ? left : Value(utils::to_string(left)),
+            right.is_string() ? right : Value(utils::to_string(right)));
+    }
 
-    case TokenType::GREATER:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) > std::get<double>(right);
+    case BinaryOp::GREATER:
+        ensure_num_operands(line, left, right);
+        return left.as_number() > right.as_number();
 
-    case TokenType::GREATER_EQUAL:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) >= std::get<double>(right);
+    case BinaryOp::GREATER_EQUAL:
+        ensure_num_operands(line, left, right);
+        return left.as_number() >= right.as_number();
 
-    case TokenType::LESS:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) < std::get<double>(right);
+    case BinaryOp::LESS:
+        ensure_num_operands(line, left, right);
+        return left.as_number() < right.as_number();
 
-    case TokenType::LESS_EQUAL:
-        ensure_num_operands(binary.op, {left, right});
-        return std::get<double>(left) <= std::get<double>(right);
+    case BinaryOp::LESS_EQUAL:
+        ensure_num_operands(line, left, right);
+        return left.as_number() <= right.as_number();
 
-    case TokenType::BANG_EQUAL:
+    case BinaryOp::NOT_EQUAL:
         return !is_equal(left, right);
 
-    case TokenType::EQUAL_EQUAL:
+    case BinaryOp::EQUAL:
         return is_equal(left, right);
 
     default:
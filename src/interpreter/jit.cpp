@@ -0,0 +1,681 @@
+#include "interpreter/jit.hpp"
+
+#include "utils/templ.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define KOBY_JIT 1
+#include <sys/mman.h>
+#else
+#define KOBY_JIT 0
+#endif
+
+namespace {
+
+#if KOBY_JIT
+
+/* Thrown while generating code for a construct the JIT does not compile, the function is left to the interpreter */
+struct Unsupported {};
+
+/* Condition codes of the jumps taken on the flags set by ucomisd */
+enum Cond : uint8_t {
+    JB  = 0x82,
+    JAE = 0x83,
+    JE  = 0x84,
+    JNE = 0x85,
+    JBE = 0x86,
+    JA  = 0x87,
+    JP  = 0x8A,
+};
+
+/**
+ * Emits the few x86-64 instructions the templates are made of. Doubles live in xmm0 and xmm1 while an
+ * operation runs, in slots of the frame addressed from rbp otherwise. rbx holds the Jit, r12 the result.
+ */
+class Assembler {
+    std::vector<int64_t>                      labels;
+    std::vector<std::pair<size_t, uint32_t>> fixups;
+
+public:
+    using Label = uint32_t;
+
+    std::vector<uint8_t> bytes;
+
+    void emit(const std::initializer_list<uint8_t> code) {
+        bytes.insert(bytes.end(), code);
+    }
+
+    void imm32(const int32_t value) {
+        const auto bits = std::bit_cast<uint32_t>(value);
+        for(int k = 0; k < 4; k++)
+            bytes.push_back(static_cast<uint8_t>(bits >> 8 * k));
+    }
+
+    void imm64(const uint64_t value) {
+        for(int k = 0; k < 8; k++)
+            bytes.push_back(static_cast<uint8_t>(value >> 8 * k));
+    }
+
+    Label label() {
+        labels.push_back(-1);
+        return static_cast<Label>(labels.size() - 1);
+    }
+
+    void bind(const Label label) {
+        labels[label] = static_cast<int64_t>(bytes.size());
+    }
+
+    void jump(const Label label) {
+        emit({0xE9});
+        fixups.emplace_back(bytes.size(), label);
+        imm32(0);
+    }
+
+    void jump_if(const Cond cond, const Label label) {
+        emit({0x0F, cond});
+        fixups.emplace_back(bytes.size(), label);
+        imm32(0);
+    }
+
+    /* Resolves the jumps, relative to the end of their instruction */
+    void link() {
+        for(const auto& [at, label] : fixups) {
+            const auto rel = static_cast<int32_t>(labels[label] - static_cast<int64_t>(at + 4));
+            std::memcpy(bytes.data() + at, &rel, sizeof rel);
+        }
+    }
+
+    // movsd xmm, [rbp + disp]
+    void load(const uint8_t xmm, const int32_t disp) {
+        emit({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x85 | xmm << 3)});
+        imm32(disp);
+    }
+
+    // movsd [rbp + disp], xmm
+    void store(const int32_t disp, const uint8_t xmm) {
+        emit({0xF2, 0x0F, 0x11, static_cast<uint8_t>(0x85 | xmm << 3)});
+        imm32(disp);
+    }
+
+    // mov rax, bits; movq xmm, rax
+    void constant(const uint8_t xmm, const uint64_t bits) {
+        emit({0x48, 0xB8});
+        imm64(bits);
+        emit({0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | xmm << 3)});
+    }
+
+    // addsd, subsd, mulsd or divsd xmm0, xmm1
+    void arithmetic(const uint8_t opcode) {
+        emit({0xF2, 0x0F, opcode, 0xC1});
+    }
+
+    // movapd xmm1, xmm0
+    void move_right() {
+        emit({0x66, 0x0F, 0x28, 0xC8});
+    }
+
+    // ucomisd xmm0, xmm1 or, swapped, ucomisd xmm1, xmm0
+    void compare(const bool swapped) {
+        emit({0x66, 0x0F, 0x2E, static_cast<uint8_t>(swapped ? 0xC8 : 0xC1)});
+    }
+
+    // mov rax, function; call rax
+    void call(const void* function) {
+        emit({0x48, 0xB8});
+        imm64(reinterpret_cast<uint64_t>(function));
+        emit({0xFF, 0xD0});
+    }
+};
+
+/**
+ * Generates the code of one function body, or throws Unsupported. Locals and temporaries get slots of the
+ * frame like registers of the Compiler, allocated as a stack, and a reference is bound to the slot of the
+ * first candidate declared by then. Anything read from elsewhere is not supported, but the callee of a call.
+ *
+ * Only the values of statements ending the body matter. A path where that value would not be a number,
+ * a loop that ran no iteration or an if whose condition failed, bails out.
+ */
+class Codegen {
+    struct Block {
+        uint32_t          base;
+        std::vector<bool> declared;
+        uint32_t          saved;
+    };
+
+    struct Loop {
+        Assembler::Label start;
+        Assembler::Label exit;
+    };
+
+    const Ast&         ast;
+    Assembler          as;
+    std::vector<Block> blocks;
+    std::vector<Loop>  loops;
+    uint32_t           top    = 0;
+    uint32_t           slots  = 0;
+    uint32_t           result = 0;
+    Assembler::Label   ok     = 0;
+    Assembler::Label   bail   = 0;
+
+    /* Callees of the calls made, their sites are numbered from `site_base` and go through `call_site` */
+    std::vector<std::pair<Symbol, uint32_t>> targets;
+    const uint32_t                           site_base;
+    const void*                              call_site;
+
+    static int32_t disp(const uint32_t slot) {
+        // Below the saved rbx and r12
+        return -24 - 8 * static_cast<int32_t>(slot);
+    }
+
+    uint32_t push() {
+        slots = std::max(slots, ++top);
+        return top - 1;
+    }
+
+    void enter(const uint32_t size) {
+        blocks.push_back({.base = top, .declared = std::vector<bool>(size), .saved = top});
+        top += size;
+        slots = std::max(slots, top);
+    }
+
+    void leave() {
+        top = blocks.back().saved;
+        blocks.pop_back();
+    }
+
+    uint32_t local(const std::span<const Coord> coords) const {
+        for(const auto coord : coords) {
+            if(coord.depth >= blocks.size())
+                throw Unsupported{};
+            const auto& block = blocks[blocks.size() - 1 - coord.depth];
+            if(block.declared[coord.slot])
+                return block.base + coord.slot;
+        }
+        throw Unsupported{};
+    }
+
+    /* Whether a name is certainly a global, no scope of this function or an enclosing one declared it */
+    bool global(const std::span<const Coord> coords) const {
+        return std::ranges::all_of(coords, [this](const Coord coord) {
+            return coord.depth < blocks.size() && !blocks[blocks.size() - 1 - coord.depth].declared[coord.slot];
+        });
+    }
+
+    void statements(const std::span<const StmtId> statements, const bool value) {
+        if(statements.empty() && value)
+            as.jump(bail);
+        for(size_t k = 0; k < statements.size(); k++)
+            statement(statements[k], value && k + 1 == statements.size());
+    }
+
+    void statement(const StmtId id, const bool value) {
+        std::visit(
+            overloaded{
+                [&](const ExprStmt& stmt) {
+                    expr(stmt.expr);
+                    if(value)
+                        as.store(disp(result), 0);
+                },
+                [&](const VarDeclStmt& stmt) {
+                    auto& declared = blocks.back().declared;
+                    if(stmt.initializer == ExprId::NONE || declared[stmt.name.slot])
+                        throw Unsupported{};
+                    expr(stmt.initializer);
+                    as.store(disp(blocks.back().base + stmt.name.slot), 0);
+                    declared[stmt.name.slot] = true;
+                    if(value)
+                        as.store(disp(result), 0);
+                },
+                [&](const BlockStmt& stmt) {
+                    if(stmt.captured)
+                        throw Unsupported{};
+                    enter(stmt.slots);
+                    statements(ast.list(stmt.statements), value);
+                    leave();
+                },
+                [&](const IfStmt& stmt) {
+                    const auto skip = as.label();
+                    branch(stmt.condition, false, skip);
+                    statement(stmt.then_branch, value);
+                    if(stmt.else_branch == StmtId::NONE && !value) {
+                        as.bind(skip);
+                        return;
+                    }
+                    const auto end = as.label();
+                    as.jump(end);
+                    as.bind(skip);
+                    if(stmt.else_branch != StmtId::NONE)
+                        statement(stmt.else_branch, value);
+                    else
+                        as.jump(bail);
+                    as.bind(end);
+                },
+                [&](const WhileStmt& stmt) { loop(stmt, value); },
+                [&](const BreakStmt) { as.jump(loops.back().exit); },
+                [&](const ContinueStmt) { as.jump(loops.back().start); },
+                [&](const ReturnStmt& stmt) {
+                    if(stmt.value == ExprId::NONE)
+                        throw Unsupported{};
+                    expr(stmt.value);
+                    // movsd [r12], xmm0
+                    as.emit({0xF2, 0x41, 0x0F, 0x11, 0x04, 0x24});
+                    as.jump(ok);
+                },
+                [](const auto&) { throw Unsupported{}; },
+            },
+            ast.stmt(id));
+    }
+
+    void loop(const WhileStmt& stmt, const bool value) {
+        if(stmt.captured)
+            throw Unsupported{};
+        // The loop's own scope only holds its hoisted values, evaluated on every use instead
+        if(stmt.hoisted.size != 0)
+            enter(0);
+        // Set once an iteration completed, the loop is worth nil until then
+        const auto completed = value ? push() : 0;
+        if(value) {
+            // mov qword [rbp + disp], 0
+            as.emit({0x48, 0xC7, 0x85});
+            as.imm32(disp(completed));
+            as.imm32(0);
+        }
+        const auto start = as.label();
+        const auto exit  = as.label();
+        as.bind(start);
+        branch(stmt.condition, false, exit);
+        loops.push_back({start, exit});
+        statement(stmt.body, value);
+        loops.pop_back();
+        if(value) {
+            as.emit({0x48, 0xC7, 0x85});
+            as.imm32(disp(completed));
+            as.imm32(1);
+        }
+        as.jump(start);
+        as.bind(exit);
+        if(value) {
+            // cmp qword [rbp + disp], 0
+            as.emit({0x48, 0x83, 0xBD});
+            as.imm32(disp(completed));
+            as.emit({0x00});
+            as.jump_if(JE, bail);
+            top--;
+        }
+        if(stmt.hoisted.size != 0)
+            leave();
+    }
+
+    /* Evaluates a number into xmm0 */
+    void expr(const ExprId id) {
+        std::visit(
+            overloaded{
+                [&](const Literal& literal) {
+                    const auto* number = std::get_if<double>(&literal);
+                    if(!number)
+                        throw Unsupported{};
+                    as.constant(0, std::bit_cast<uint64_t>(*number));
+                },
+                [&](const Variable& variable) { as.load(0, disp(local(ast.list(variable.coords)))); },
+                [&](const Grouping& grouping) { expr(grouping.expr); },
+                [&](const Unary& unary) {
+                    if(unary.op != UnaryOp::NEGATE)
+                        throw Unsupported{};
+                    expr(unary.right);
+                    // Flips the sign bit: xorpd xmm0, xmm1
+                    as.constant(1, 0x8000'0000'0000'0000);
+                    as.emit({0x66, 0x0F, 0x57, 0xC1});
+                },
+                [&](const Binary& binary) {
+                    if(binary.op > BinaryOp::MODULO)
+                        throw Unsupported{};
+                    operands(binary);
+                    switch(binary.op) {
+                    case BinaryOp::ADD:
+                        as.arithmetic(0x58);
+                        break;
+                    case BinaryOp::SUBTRACT:
+                        as.arithmetic(0x5C);
+                        break;
+                    case BinaryOp::MULTIPLY:
+                        as.arithmetic(0x59);
+                        break;
+                    case BinaryOp::DIVIDE:
+                        as.arithmetic(0x5E);
+                        break;
+                    default:
+                        as.call(reinterpret_cast<const void*>(&modulo));
+                        break;
+                    }
+                },
+                [&](const Assign& assigned) {
+                    const auto slot = local(ast.list(assigned.coords));
+                    expr(assigned.value);
+                    as.store(disp(slot), 0);
+                },
+                [&](const Call& call) { this->call(call); },
+                [&](const Inline& inlined) { expr(inlined.call); },
+                [&](const Hoisted& hoisted) { expr(hoisted.expr); },
+                [](const auto&) { throw Unsupported{}; },
+            },
+            ast.expr(id));
+    }
+
+    /* Evaluates the left operand into xmm0 and the right one into xmm1, in that order */
+    void operands(const Binary& binary) {
+        const auto left = push();
+        expr(binary.left);
+        as.store(disp(left), 0);
+        expr(binary.right);
+        as.move_right();
+        as.load(0, disp(left));
+        top--;
+    }
+
+    static double modulo(const double left, const double right) {
+        return std::fmod(left, right);
+    }
+
+    void call(const Call& call) {
+        const auto* callee = std::get_if<Variable>(&ast.expr(call.callee));
+        if(!callee || !global(ast.list(callee->coords)))
+            throw Unsupported{};
+        const auto args = ast.list(call.args);
+        const auto argc = static_cast<uint32_t>(args.size());
+        // Arguments go in ascending addresses, so in slots going down, with the result slot after them
+        const auto base = top;
+        for(uint32_t k = 0; k <= argc; k++)
+            push();
+        for(uint32_t k = 0; k < argc; k++) {
+            expr(args[k]);
+            as.store(disp(base + argc - 1 - k), 0);
+        }
+        const auto out = base + argc;
+        // mov rdi, rbx; mov esi, site; lea rdx, [rbp + args]; lea rcx, [rbp + out]
+        as.emit({0x48, 0x89, 0xDF});
+        as.emit({0xBE});
+        as.imm32(static_cast<int32_t>(site_base + targets.size()));
+        as.emit({0x48, 0x8D, 0x95});
+        as.imm32(disp(argc != 0 ? base + argc - 1 : out));
+        as.emit({0x48, 0x8D, 0x8D});
+        as.imm32(disp(out));
+        as.call(call_site);
+        // test eax, eax; jnz bail
+        as.emit({0x85, 0xC0});
+        as.jump_if(JNE, bail);
+        as.load(0, disp(out));
+        targets.emplace_back(callee->name, argc);
+        top = base;
+    }
+
+    /* Jumps to `label` when the truthiness of a condition is `when`, without materializing booleans */
+    void branch(const ExprId id, const bool when, const Assembler::Label label) {
+        std::visit(
+            overloaded{
+                [&](const Grouping& grouping) { branch(grouping.expr, when, label); },
+                [&](const Unary& unary) {
+                    if(unary.op == UnaryOp::NOT)
+                        branch(unary.right, !when, label);
+                    else
+                        number(id, when, label);
+                },
+                [&](const Logical& logical) {
+                    // `and` fails as soon as one side fails, `or` succeeds as soon as one side succeeds
+                    const bool shortcut = logical.op == LogicalOp::OR;
+                    if(when == shortcut) {
+                        branch(logical.left, when, label);
+                        branch(logical.right, when, label);
+                        return;
+                    }
+                    const auto skip = as.label();
+                    branch(logical.left, shortcut, skip);
+                    branch(logical.right, when, label);
+                    as.bind(skip);
+                },
+                [&](const Literal& literal) {
+                    const bool truthy = std::visit(
+                        overloaded{
+                            [](const bool boolean) { return boolean; },
+                            [](const std::nullptr_t) { return false; },
+                            [](const double) { return true; },
+                            [](const auto&) -> bool { throw Unsupported{}; },
+                        },
+                        literal);
+                    if(truthy == when)
+                        as.jump(label);
+                },
+                [&](const Binary& binary) {
+                    if(binary.op <= BinaryOp::MODULO) {
+                        number(id, when, label);
+                        return;
+                    }
+                    operands(binary);
+                    compare(binary.op, when, label);
+                },
+                [&](const auto&) { number(id, when, label); },
+            },
+            ast.expr(id));
+    }
+
+    /* A number is always truthy, it is only evaluated for the calls it makes */
+    void number(const ExprId id, const bool when, const Assembler::Label label) {
+        expr(id);
+        if(when)
+            as.jump(label);
+    }
+
+    // Unordered operands, a NaN, set ZF, PF and CF: every comparison but != is false then
+    void compare(const BinaryOp op, const bool when, const Assembler::Label label) {
+        switch(op) {
+        case BinaryOp::GREATER:
+        case BinaryOp::LESS:
+            as.compare(op == BinaryOp::LESS);
+            as.jump_if(when ? JA : JBE, label);
+            break;
+        case BinaryOp::GREATER_EQUAL:
+        case BinaryOp::LESS_EQUAL:
+            as.compare(op == BinaryOp::LESS_EQUAL);
+            as.jump_if(when ? JAE : JB, label);
+            break;
+        default: {
+            as.compare(false);
+            if(when == (op == BinaryOp::NOT_EQUAL)) {
+                as.jump_if(JP, label);
+                as.jump_if(JNE, label);
+                break;
+            }
+            const auto skip = as.label();
+            as.jump_if(JP, skip);
+            as.jump_if(JE, label);
+            as.bind(skip);
+            break;
+        }
+        }
+    }
+
+public:
+    Codegen(const Ast& ast, const uint32_t site_base, const void* call_site)
+        : ast(ast), site_base(site_base), call_site(call_site) {}
+
+    /* Code of a body taking `params` in order, its call sites are given as (callee, argument count) */
+    std::vector<uint8_t> generate(const ResolvedBody& body, const std::span<const Name> params) {
+        if(body.captured)
+            throw Unsupported{};
+        enter(static_cast<uint32_t>(std::max<size_t>(body.slots, params.size())));
+        for(size_t k = 0; k < params.size(); k++) {
+            if(params[k].slot != k || blocks.back().declared[k])
+                throw Unsupported{};
+            blocks.back().declared[k] = true;
+        }
+        result = push();
+        ok     = as.label();
+        bail   = as.label();
+
+        // push rbp; mov rbp, rsp; push rbx; push r12; sub rsp, frame
+        as.emit({0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x48, 0x81, 0xEC});
+        const auto frame = as.bytes.size();
+        as.imm32(0);
+        // mov rbx, rdx; mov r12, rsi
+        as.emit({0x48, 0x89, 0xD3, 0x49, 0x89, 0xF4});
+        for(uint32_t k = 0; k < params.size(); k++) {
+            // movsd xmm0, [rdi + 8k]
+            as.emit({0xF2, 0x0F, 0x10, 0x87});
+            as.imm32(static_cast<int32_t>(8 * k));
+            as.store(disp(k), 0);
+        }
+
+        statements(body.statements, true);
+        as.load(0, disp(result));
+        as.emit({0xF2, 0x41, 0x0F, 0x11, 0x04, 0x24});
+
+        const auto exit = as.label();
+        as.bind(ok);
+        // xor eax, eax
+        as.emit({0x31, 0xC0});
+        as.bind(exit);
+        // lea rsp, [rbp - 16]; pop r12; pop rbx; pop rbp; ret
+        as.emit({0x48, 0x8D, 0x65, 0xF0, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+        as.bind(bail);
+        // mov eax, 1
+        as.emit({0xB8, 0x01, 0x00, 0x00, 0x00});
+        as.jump(exit);
+        as.link();
+
+        // The frame keeps rsp 16-byte aligned for the calls made
+        const auto size = static_cast<int32_t>((8 * slots + 15) & ~15u);
+        std::memcpy(as.bytes.data() + frame, &size, sizeof size);
+        return std::move(as.bytes);
+    }
+
+    [[nodiscard]]
+    const std::vector<std::pair<Symbol, uint32_t>>& calls() const {
+        return targets;
+    }
+};
+
+#endif
+
+} // namespace
+
+Jit::~Jit() {
+#if KOBY_JIT
+    for(const auto& [memory, size] : code)
+        munmap(memory, size);
+#endif
+}
+
+bool Jit::supported() {
+    return KOBY_JIT;
+}
+
+Jit::Stats Jit::statistics() const {
+    return stats;
+}
+
+Jit::Function& Jit::function(const Func& func) {
+    return functions[&func.ast->body(func.body)];
+}
+
+std::optional<double> Jit::call(const Func& func, const std::span<const Value> args) {
+    auto& function = this->function(func);
+    if(function.state == State::COUNTING && ++function.calls >= threshold)
+        compile(func, function);
+    if(function.state != State::COMPILED)
+        return std::nullopt;
+
+    arguments.clear();
+    for(const auto& arg : args) {
+        if(!arg.is_number()) {
+            bail(function);
+            return std::nullopt;
+        }
+        arguments.push_back(arg.as_number());
+    }
+    double result = 0;
+    if(function.entry(arguments.data(), &result, this) == 0)
+        return result;
+    bail(function);
+    return std::nullopt;
+}
+
+void Jit::bail(Function& function) {
+    stats.bailouts++;
+    if(++function.bailouts < MAX_BAILOUTS)
+        return;
+    function.state = State::REJECTED;
+    stats.deoptimized++;
+}
+
+void Jit::compile(const Func& func, Function& function) {
+    function.state = State::REJECTED;
+#if KOBY_JIT
+    const auto body = interpreter.function_body(*func.ast, func.body);
+    auto codegen = Codegen(body.ast, static_cast<uint32_t>(sites.size()), reinterpret_cast<const void*>(&call_site));
+    auto bytes   = std::vector<uint8_t>{};
+    try {
+        bytes = codegen.generate(body, func.ast->list(func.params));
+    } catch(const Unsupported&) {
+        return;
+    }
+
+    // Written then made executable, never both at once
+    const auto size   = bytes.size();
+    void*      memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+        return;
+    std::memcpy(memory, bytes.data(), size);
+    if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return;
+    }
+    code.push_back({memory, size});
+    for(const auto& [name, argc] : codegen.calls())
+        sites.push_back({.name = name, .argc = argc});
+    function.entry = reinterpret_cast<Entry>(memory);
+    function.state = State::COMPILED;
+    stats.compiled++;
+#else
+    (void)func;
+#endif
+}
+
+int Jit::call_site(Jit* jit, const uint32_t index, const double* args, double* result) noexcept {
+    // Nothing may unwind through machine code, any failure is a bailout and the interpreter reports it
+    try {
+        auto* site = &jit->sites[index];
+        if(!site->global)
+            site->global = jit->interpreter.globals()->find(site->name);
+        if(!site->global)
+            return 1;
+        if(!site->global->is_callable())
+            return 1;
+        const auto& callable = site->global->as_callable();
+        if(callable.get() != site->callee.get()) {
+            const auto* func = dynamic_cast<const Func*>(callable.get());
+            if(!func || func->arity() != site->argc)
+                return 1;
+            auto& function = jit->function(*func);
+            // A function called from compiled code is hot too, compiling it adds sites
+            if(function.state == State::COUNTING) {
+                jit->compile(*func, function);
+                site = &jit->sites[index];
+            }
+            // Holding the callee keeps another function from reusing its address
+            site->callee   = callable;
+            site->function = &function;
+        }
+        const auto* function = site->function;
+        if(function->state != State::COMPILED || jit->depth >= MAX_DEPTH)
+            return 1;
+        jit->depth++;
+        const int status = function->entry(args, result, jit);
+        jit->depth--;
+        return status;
+    } catch(...) {
+        return 1;
+    }
+}
@@ -0,0 +1,95 @@
+#include "interpreter/layout.hpp"
+
+#include "types/error_code.hpp"
+#include "utils/errorx.hpp"
+
+#include <algorithm>
+
+void Layout::reserve(const uint32_t count) {
+    top += count;
+    if(top >= limit)
+        throw err::make(err::TOO_MANY_REGISTERS, "Too many local variables and temporaries in one function.", -1);
+    size = std::max(size, top);
+}
+
+uint32_t Layout::environments(const uint32_t depth) const {
+    // Scopes of enclosing functions all have an environment, a closure was created in them
+    const auto own   = static_cast<uint32_t>(blocks.size());
+    uint32_t   count = depth > own ? depth - own : 0;
+    for(uint32_t k = 0; k < std::min(depth, own); k++)
+        count += blocks[own - 1 - k].captured ? 1 : 0;
+    return count;
+}
+
+uint32_t Layout::environments() const {
+    return environments(static_cast<uint32_t>(blocks.size()));
+}
+
+Layout::Place Layout::place(const std::span<const Coord> coords) const {
+    const auto own = static_cast<uint32_t>(blocks.size());
+    for(size_t k = 0; k < coords.size(); k++) {
+        if(coords[k].depth >= own) {
+            // Whether a scope of an enclosing function declared the name by now is only known when it runs
+            auto found = Place{.kind = Place::ENVIRONMENT};
+            for(; k < coords.size(); k++)
+                found.coords.push_back({environments(coords[k].depth), coords[k].slot});
+            return found;
+        }
+        const auto& block = blocks[own - 1 - coords[k].depth];
+        if(!block.declared[coords[k].slot])
+            continue;
+        if(!block.captured)
+            return {.kind = Place::REGISTER, .index = block.base + coords[k].slot};
+        return {.kind = Place::ENVIRONMENT, .coords = {{environments(coords[k].depth), coords[k].slot}}};
+    }
+    return {.kind = Place::GLOBAL};
+}
+
+std::optional<size_t> Layout::call(const uint32_t slots, const bool captured, const std::span<const Name> params) {
+    auto block     = Block{.captured = captured, .base = top, .declared = std::vector<bool>(slots), .saved = top};
+    auto duplicate = std::optional<size_t>{};
+    if(!captured) {
+        // Distinct parameters get the first slots in order, so each argument already sits in its slot
+        block.registers = static_cast<uint32_t>(std::max<size_t>(slots, params.size()));
+        reserve(block.registers);
+    }
+    for(size_t k = 0; k < params.size(); k++) {
+        if(block.declared[params[k].slot] && !duplicate)
+            duplicate = k;
+        block.declared[params[k].slot] = true;
+    }
+    blocks.push_back(std::move(block));
+    return duplicate;
+}
+
+void Layout::enter(const uint32_t slots, const bool captured) {
+    auto block = Block{.captured = captured, .base = top, .declared = std::vector<bool>(slots), .saved = top};
+    if(!captured) {
+        block.registers = slots;
+        reserve(slots);
+    }
+    blocks.push_back(std::move(block));
+}
+
+void Layout::enter_loop(const uint32_t hoisted, const bool captured) {
+    // Each hoisted value sits next to a flag telling whether it was computed in this run of the loop
+    auto block = Block{
+        .captured  = captured,
+        .base      = top,
+        .registers = 2 * hoisted,
+        .declared  = std::vector<bool>(hoisted),
+        .hoisted   = top,
+        .saved     = top,
+    };
+    reserve(2 * hoisted);
+    blocks.push_back(std::move(block));
+}
+
+void Layout::leave() {
+    top = blocks.back().saved;
+    blocks.pop_back();
+}
+
+uint32_t Layout::hoisted(const Coord coord) const {
+    return blocks[blocks.size() - 1 - coord.depth].hoisted + 2 * coord.slot;
+}
@@ -0,0 +1,679 @@
+#include "interpreter/optimizer.hpp"
+
+#include "const/characters.hpp"
+#include "interpreter/interpreter.hpp"
+#include "types/error.hpp"
+#include "utils/templ.hpp"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace {
+
+constexpr std::string_view binary_text(const BinaryOp op) {
+    switch(op) {
+    case BinaryOp::ADD:
+        return "+";
+    case BinaryOp::SUBTRACT:
+        return "-";
+    case BinaryOp::MULTIPLY:
+        return "*";
+    case BinaryOp::DIVIDE:
+        return "/";
+    case BinaryOp::MODULO:
+        return "%";
+    case BinaryOp::GREATER:
+        return ">";
+    case BinaryOp::GREATER_EQUAL:
+        return ">=";
+    case BinaryOp::LESS:
+        return "<";
+    case BinaryOp::LESS_EQUAL:
+        return "<=";
+    case BinaryOp::EQUAL:
+        return "==";
+    case BinaryOp::NOT_EQUAL:
+        return "!=";
+    }
+    return "?";
+}
+
+void show_literal(std::string& out, const Ast& ast, const Literal& literal) {
+    std::visit(
+        overloaded{
+            [&out](std::nullptr_t) { out += keyword::Nil; },
+            // Shortest text that reads back to the same double, so folded results can be checked exactly
+            [&out](const double num) { out += std::format("{}", num); },
+            [&](const StringId string) { out += std::format("\"{}\"", ast.string(string)); },
+            [&out](const bool boolean) { out += boolean ? keyword::True : keyword::False; },
+        },
+        literal);
+}
+
+/* Source form of an expression, lambda bodies are elided */
+void show(std::string& out, const Ast& ast, const ExprId id) {
+    std::visit(
+        overloaded{
+            [&](const Binary& expr) {
+                show(out, ast, expr.left);
+                out += std::format(" {} ", binary_text(expr.op));
+                show(out, ast, expr.right);
+            },
+            [&](const Logical& expr) {
+                show(out, ast, expr.left);
+                out += std::format(" {} ", expr.op == LogicalOp::AND ? keyword::And : keyword::Or);
+                show(out, ast, expr.right);
+            },
+            [&](const Unary& expr) {
+                out += expr.op == UnaryOp::NEGATE ? "-" : "!";
+                show(out, ast, expr.right);
+            },
+            [&](const Grouping& expr) {
+                out += "(";
+                show(out, ast, expr.expr);
+                out += ")";
+            },
+            [&](const Literal& expr) { show_literal(out, ast, expr); },
+            [&](const Variable& expr) { out += expr.name.name(); },
+            [&](const Assign& expr) {
+                out += std::format("{} = ", expr.name.name());
+                show(out, ast, expr.value);
+            },
+            [&](const Call& expr) {
+                show(out, ast, expr.callee);
+                out += "(";
+                auto separator = "";
+                for(const auto arg : ast.list(expr.args)) {
+                    out += std::exchange(separator, ", ");
+                    show(out, ast, arg);
+                }
+                out += ")";
+            },
+            [&](const Lambda& expr) {
+                out += "->(";
+                auto separator = "";
+                for(const auto& param : ast.list(expr.params)) {
+                    out += std::exchange(separator, ", ");
+                    out += param.symbol.name();
+                }
+                out += ") { ... }";
+            },
+            // Only the inliner adds these, after optimizing, shown as the call they stand for
+            [&](const Inline& expr) { show(out, ast, expr.call); },
+            [&](const Param& expr) { out += "$" + std::to_string(expr.index); },
+            [&](const Hoisted& expr) { show(out, ast, expr.expr); },
+        },
+        ast.expr(id));
+}
+
+std::string show(const Ast& ast, const ExprId id) {
+    std::string out;
+    show(out, ast, id);
+    return out;
+}
+
+Value value_of(const Ast& ast, const Literal& literal) {
+    return std::visit(
+        overloaded{
+            [&ast](const StringId string) { return ast.string_value(string); },
+            [](const auto& val) { return Value(val); },
+        },
+        literal);
+}
+
+Literal literal_of(Ast& ast, const Value& value) {
+    if(value.is_number())
+        return value.as_number();
+    if(value.is_bool())
+        return value.as_bool();
+    if(value.is_string())
+        return ast.add_string(value.as_string());
+    return nullptr;
+}
+
+} // namespace
+
+void Optimizer::optimize(const Program& program, OptimizeReport* report) {
+    auto optimizer = Optimizer(*program.ast, report);
+    for(const auto stmt : program.statements)
+        optimizer.fold(stmt);
+
+    size_t reachable = 0;
+    if(report) {
+        for(const auto stmt : program.statements)
+            reachable += optimizer.count(stmt);
+    }
+    for(const auto stmt : program.statements)
+        optimizer.eliminate(stmt);
+    if(report) {
+        for(const auto stmt : program.statements)
+            reachable -= optimizer.count(stmt);
+        report->removed += reachable;
+    }
+    optimizer.hoist(program.statements);
+}
+
+void Optimizer::optimize(Ast& ast, NodeList<StmtId>& statements) {
+    auto optimizer = Optimizer(ast, nullptr);
+    optimizer.fold(ast.list(statements));
+    optimizer.eliminate(statements);
+    optimizer.hoist(ast.list(statements));
+}
+
+void Optimizer::fold(const std::span<const StmtId> statements) {
+    for(const auto stmt : statements)
+        fold(stmt);
+}
+
+void Optimizer::fold(const StmtId id) {
+    if(id == StmtId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](ExprStmt& stmt) { stmt.expr = fold(stmt.expr); },
+            [this](IfStmt& stmt) {
+                stmt.condition = fold(stmt.condition);
+                fold(stmt.then_branch);
+                fold(stmt.else_branch);
+            },
+            [this](VarDeclStmt& stmt) { stmt.initializer = fold(stmt.initializer); },
+            [this](const FuncDeclStmt& stmt) { fold(stmt.body); },
+            [this](const BlockStmt& stmt) { fold(ast.list(stmt.statements)); },
+            [this](WhileStmt& stmt) {
+                stmt.condition = fold(stmt.condition);
+                fold(stmt.body);
+            },
+            [this](ReturnStmt& stmt) { stmt.value = fold(stmt.value); },
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+void Optimizer::fold(const BodyId id) {
+    // A deferred body is optimized when it is parsed, on its first call
+    if(const auto& body = ast.body(id); !body.deferred && !body.ast)
+        fold(ast.list(body.statements));
+}
+
+ExprId Optimizer::fold(const ExprId id) {
+    if(id == ExprId::NONE)
+        return id;
+    if(!report)
+        return fold_node(id);
+
+    // Only the outermost rewrite of a subtree is reported, it covers the ones made inside it
+    auto&        rewrites = report->folded;
+    const size_t recorded = rewrites.size();
+    const bool   literal  = std::holds_alternative<Literal>(ast.expr(id));
+    auto         before   = literal ? std::string() : show(ast, id);
+    const auto   result   = fold_node(id);
+    if(!literal && (result != id || std::holds_alternative<Literal>(ast.expr(id)))) {
+        rewrites.resize(recorded);
+        rewrites.push_back({ast.line(id), std::move(before), show(ast, result)});
+    }
+    return result;
+}
+
+ExprId Optimizer::fold_node(const ExprId id) {
+    // Folding writes literals in place and never adds nodes, so references into the arena stay valid
+    auto&      node       = ast.expr(id);
+    const auto as_literal = [this](const ExprId expr) { return std::get_if<Literal>(&ast.expr(expr)); };
+    const auto evaluate   = [this, id](const auto& apply) -> ExprId {
+        try {
+            ast.expr(id) = literal_of(ast, apply());
+        } catch(Error&) {
+            // Left as is, the runtime reports the error when the expression is actually evaluated
+        }
+        return id;
+    };
+
+    return std::visit<ExprId>(
+        overloaded{
+            [&](Binary& expr) {
+                expr.left  = fold(expr.left);
+                expr.right = fold(expr.right);
+                const auto* left  = as_literal(expr.left);
+                const auto* right = as_literal(expr.right);
+                if(!left || !right)
+                    return id;
+                return evaluate([&] {
+                    return Interpreter::binary(expr.op, value_of(ast, *left), value_of(ast, *right), ast.line(id));
+                });
+            },
+            [&](Unary& expr) {
+                expr.right        = fold(expr.right);
+                const auto* right = as_literal(expr.right);
+                if(!right)
+                    return id;
+                return evaluate([&] { return Interpreter::unary(expr.op, value_of(ast, *right), ast.line(id)); });
+            },
+            [&](Grouping& expr) {
+                expr.expr = fold(expr.expr);
+                return as_literal(expr.expr) ? expr.expr : id;
+            },
+            [&](Logical& expr) {
+                expr.left         = fold(expr.left);
+                expr.right        = fold(expr.right);
+                const auto* left  = as_literal(expr.left);
+                if(!left)
+                    return id;
+                // 'or' yields a truthy left operand, 'and' a falsy one, anything else yields the right operand
+                const bool truthy = Interpreter::is_truthy(value_of(ast, *left));
+                return truthy == (expr.op == LogicalOp::OR) ? expr.left : expr.right;
+            },
+            [&](Assign& expr) {
+                expr.value = fold(expr.value);
+                return id;
+            },
+            [&](Call& expr) {
+                expr.callee = fold(expr.callee);
+                for(auto& arg : ast.list(expr.args))
+                    arg = fold(arg);
+                return id;
+            },
+            [&](const Lambda& expr) {
+                fold(expr.body);
+                return id;
+            },
+            [&](const auto&) { return id; },
+        },
+        node);
+}
+
+void Optimizer::eliminate(NodeList<StmtId>& statements) {
+    const auto items = ast.list(statements);
+    uint32_t   kept  = 0;
+    for(size_t k = 0; k < items.size(); k++) {
+        const auto stmt = items[k];
+        eliminate(stmt);
+        // The last statement is the value of the block even when it does nothing else
+        if(k + 1 < items.size() && is_inert(stmt))
+            continue;
+        items[kept++] = stmt;
+        // A block stops at the first statement that returns, breaks or continues, the rest never runs
+        if(terminates(stmt))
+            break;
+    }
+    statements.size = kept;
+}
+
+void Optimizer::eliminate(const StmtId id) {
+    if(id == StmtId::NONE)
+        return;
+    // An eliminated statement yields nil, it becomes an expression statement over its condition turned nil
+    const auto nothing = [this](const ExprId condition) {
+        ast.expr(condition) = Literal(nullptr);
+        return Stmt(ExprStmt{condition});
+    };
+    std::visit(
+        overloaded{
+            [&](ExprStmt& stmt) { eliminate(stmt.expr); },
+            [&](IfStmt& stmt) {
+                eliminate(stmt.condition);
+                eliminate(stmt.then_branch);
+                eliminate(stmt.else_branch);
+                const auto* condition = std::get_if<Literal>(&ast.expr(stmt.condition));
+                if(!condition)
+                    return;
+                const auto taken = Interpreter::is_truthy(value_of(ast, *condition)) ? stmt.then_branch
+                                                                                      : stmt.else_branch;
+                ast.stmt(id) = taken == StmtId::NONE ? nothing(stmt.condition) : Stmt(ast.stmt(taken));
+            },
+            [&](VarDeclStmt& stmt) { eliminate(stmt.initializer); },
+            [&](const FuncDeclStmt& stmt) { eliminate(stmt.body); },
+            [&](BlockStmt& stmt) { eliminate(stmt.statements); },
+            [&](WhileStmt& stmt) {
+                const auto* condition = std::get_if<Literal>(&ast.expr(stmt.condition));
+                if(condition && !Interpreter::is_truthy(value_of(ast, *condition))) {
+                    ast.stmt(id) = nothing(stmt.condition);
+                    return;
+                }
+                eliminate(stmt.condition);
+                eliminate(stmt.body);
+            },
+            [&](ReturnStmt& stmt) { eliminate(stmt.value); },
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+void Optimizer::eliminate(const BodyId id) {
+    if(const auto& body = ast.body(id); !body.deferred && !body.ast)
+        eliminate(body.statements);
+}
+
+void Optimizer::eliminate(const ExprId id) {
+    // Expressions are left as folded, only the bodies of lambdas in them hold statements
+    if(id == ExprId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](const Binary& expr) {
+                eliminate(expr.left);
+                eliminate(expr.right);
+            },
+            [this](const Logical& expr) {
+                eliminate(expr.left);
+                eliminate(expr.right);
+            },
+            [this](const Unary& expr) { eliminate(expr.right); },
+            [this](const Grouping& expr) { eliminate(expr.expr); },
+            [this](const Assign& expr) { eliminate(expr.value); },
+            [this](const Call& expr) {
+                eliminate(expr.callee);
+                for(const auto arg : ast.list(expr.args))
+                    eliminate(arg);
+            },
+            [this](const Lambda& expr) { eliminate(expr.body); },
+            [](const auto&) {},
+        },
+        ast.expr(id));
+}
+
+void Optimizer::hoist(const std::span<const StmtId> statements) {
+    for(const auto stmt : statements)
+        hoist(stmt);
+}
+
+void Optimizer::hoist(const StmtId id) {
+    if(id == StmtId::NONE)
+        return;
+    // Hoisting adds expressions and name lists, never statements, references to them stay valid
+    std::visit(
+        overloaded{
+            [this](const ExprStmt& stmt) { hoist(stmt.expr); },
+            [this](const IfStmt& stmt) {
+                hoist(stmt.condition);
+                hoist(stmt.then_branch);
+                hoist(stmt.else_branch);
+            },
+            [this](const VarDeclStmt& stmt) { hoist(stmt.initializer); },
+            [this](const FuncDeclStmt& stmt) { hoist(stmt.body); },
+            [this](const BlockStmt& stmt) { hoist(ast.list(stmt.statements)); },
+            [this](WhileStmt& stmt) {
+                auto variant = std::unordered_set<Symbol>{};
+                if(!writes(stmt.condition, variant) && !writes(stmt.body, variant)) {
+                    stmt.condition = hoist(stmt.condition, variant);
+                    hoist(stmt.body, variant);
+                    if(!hoisting.empty())
+                        stmt.hoisted = ast.add_list(std::span<const Name>(hoisting));
+                    hoisting.clear();
+                }
+                // Loops nested in this one are invariant to fewer names, lambdas in it run on their own
+                hoist(stmt.condition);
+                hoist(stmt.body);
+            },
+            [this](const ReturnStmt& stmt) { hoist(stmt.value); },
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+void Optimizer::hoist(const BodyId id) {
+    if(const auto& body = ast.body(id); !body.deferred && !body.ast)
+        hoist(ast.list(body.statements));
+}
+
+void Optimizer::hoist(const ExprId id) {
+    // Only the bodies of lambdas in an expression hold loops
+    if(id == ExprId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](const Binary& expr) {
+                hoist(expr.left);
+                hoist(expr.right);
+            },
+            [this](const Logical& expr) {
+                hoist(expr.left);
+                hoist(expr.right);
+            },
+            [this](const Unary& expr) { hoist(expr.right); },
+            [this](const Grouping& expr) { hoist(expr.expr); },
+            [this](const Assign& expr) { hoist(expr.value); },
+            [this](const Call& expr) {
+                hoist(expr.callee);
+                for(const auto arg : ast.list(expr.args))
+                    hoist(arg);
+            },
+            [this](const Lambda& expr) { hoist(expr.body); },
+            [](const auto&) {},
+        },
+        ast.expr(id));
+}
+
+void Optimizer::hoist(const StmtId id, const std::unordered_set<Symbol>& variant) {
+    if(id == StmtId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [&](ExprStmt& stmt) { stmt.expr = hoist(stmt.expr, variant); },
+            [&](IfStmt& stmt) {
+                stmt.condition = hoist(stmt.condition, variant);
+                hoist(stmt.then_branch, variant);
+                hoist(stmt.else_branch, variant);
+            },
+            [&](VarDeclStmt& stmt) { stmt.initializer = hoist(stmt.initializer, variant); },
+            [&](const BlockStmt& stmt) {
+                for(const auto inner : ast.list(stmt.statements))
+                    hoist(inner, variant);
+            },
+            [&](WhileStmt& stmt) {
+                stmt.condition = hoist(stmt.condition, variant);
+                hoist(stmt.body, variant);
+            },
+            [&](ReturnStmt& stmt) { stmt.value = hoist(stmt.value, variant); },
+            // Functions declared in the loop only run when called, which a loop hoisted from never does
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+ExprId Optimizer::hoist(const ExprId id, const std::unordered_set<Symbol>& variant) {
+    if(id == ExprId::NONE)
+        return id;
+    // Literals are folded already, reading a variable is no cheaper from the loop's environment
+    const auto& node = ast.expr(id);
+    if(!std::holds_alternative<Literal>(node) && !std::holds_alternative<Variable>(node) &&
+       !std::holds_alternative<Hoisted>(node) && is_invariant(id, variant)) {
+        // '$' starts no identifier, the name cannot clash with one of the program
+        const auto name = Name{Symbol::intern(std::format("${}", hoisted++)), ast.line(id)};
+        hoisting.push_back(name);
+        if(report)
+            report->hoisted.push_back({ast.line(id), show(ast, id), std::string(name.symbol.name())});
+        return ast.add(Hoisted{id, name.symbol}, ast.line(id));
+    }
+
+    // Hoisting adds expressions, the node is updated through a copy rather than a reference into the arena
+    auto copy = node;
+    std::visit(
+        overloaded{
+            [&](Binary& expr) {
+                expr.left  = hoist(expr.left, variant);
+                expr.right = hoist(expr.right, variant);
+            },
+            [&](Logical& expr) {
+                expr.left  = hoist(expr.left, variant);
+                expr.right = hoist(expr.right, variant);
+            },
+            [&](Unary& expr) { expr.right = hoist(expr.right, variant); },
+            [&](Grouping& expr) { expr.expr = hoist(expr.expr, variant); },
+            [&](Assign& expr) { expr.value = hoist(expr.value, variant); },
+            [](const auto&) {},
+        },
+        copy);
+    ast.expr(id) = copy;
+    return id;
+}
+
+bool Optimizer::writes(const StmtId id, std::unordered_set<Symbol>& names) const {
+    if(id == StmtId::NONE)
+        return false;
+    return std::visit(
+        overloaded{
+            [&](const ExprStmt& stmt) { return writes(stmt.expr, names); },
+            [&](const IfStmt& stmt) {
+                return writes(stmt.condition, names) || writes(stmt.then_branch, names) ||
+                       writes(stmt.else_branch, names);
+            },
+            [&](const VarDeclStmt& stmt) {
+                names.insert(stmt.name.symbol);
+                return writes(stmt.initializer, names);
+            },
+            [&](const FuncDeclStmt& stmt) {
+                names.insert(stmt.name.symbol);
+                return false;
+            },
+            [&](const BlockStmt& stmt) {
+                return std::ranges::any_of(ast.list(stmt.statements), [&](const StmtId inner) {
+                    return writes(inner, names);
+                });
+            },
+            [&](const WhileStmt& stmt) { return writes(stmt.condition, names) || writes(stmt.body, names); },
+            [&](const ReturnStmt& stmt) { return writes(stmt.value, names); },
+            [](const auto&) { return false; },
+        },
+        ast.stmt(id));
+}
+
+bool Optimizer::writes(const ExprId id, std::unordered_set<Symbol>& names) const {
+    if(id == ExprId::NONE)
+        return false;
+    return std::visit(
+        overloaded{
+            [&](const Binary& expr) { return writes(expr.left, names) || writes(expr.right, names); },
+            [&](const Logical& expr) { return writes(expr.left, names) || writes(expr.right, names); },
+            [&](const Unary& expr) { return writes(expr.right, names); },
+            [&](const Grouping& expr) { return writes(expr.expr, names); },
+            [&](const Assign& expr) {
+                names.insert(expr.name);
+                return writes(expr.value, names);
+            },
+            // Any function may assign globals and the variables it closes over
+            [](const Call&) { return true; },
+            // A lambda body runs when called, the loop calls nothing once it gets here
+            [](const auto&) { return false; },
+        },
+        ast.expr(id));
+}
+
+bool Optimizer::is_invariant(const ExprId id, const std::unordered_set<Symbol>& variant) const {
+    return std::visit(
+        overloaded{
+            [](const Literal&) { return true; },
+            [&](const Variable& expr) { return !variant.contains(expr.name); },
+            // Hoisted out of an enclosing loop, fixed for as long as this one runs
+            [](const Hoisted&) { return true; },
+            [&](const Binary& expr) { return is_invariant(expr.left, variant) && is_invariant(expr.right, variant); },
+            [&](const Logical& expr) {
+                return is_invariant(expr.left, variant) && is_invariant(expr.right, variant);
+            },
+            [&](const Unary& expr) { return is_invariant(expr.right, variant); },
+            [&](const Grouping& expr) { return is_invariant(expr.expr, variant); },
+            [](const auto&) { return false; },
+        },
+        ast.expr(id));
+}
+
+bool Optimizer::is_inert(const StmtId id) const {
+    if(const auto* stmt = std::get_if<ExprStmt>(&ast.stmt(id)))
+        return is_pure(stmt->expr);
+    if(const auto* stmt = std::get_if<BlockStmt>(&ast.stmt(id)))
+        return stmt->statements.size == 0;
+    return false;
+}
+
+bool Optimizer::is_pure(const ExprId id) const {
+    // Pure expressions can neither fail nor change anything. Reading a variable fails when it is undefined,
+    // arithmetic and comparisons fail on operands that are not numbers, while '+' accepts any operands.
+    return std::visit(
+        overloaded{
+            [](const Literal&) { return true; },
+            [](const Lambda&) { return true; },
+            [this](const Grouping& expr) { return is_pure(expr.expr); },
+            [this](const Unary& expr) { return expr.op == UnaryOp::NOT && is_pure(expr.right); },
+            [this](const Logical& expr) { return is_pure(expr.left) && is_pure(expr.right); },
+            [this](const Binary& expr) {
+                const bool total =
+                    expr.op == BinaryOp::ADD || expr.op == BinaryOp::EQUAL || expr.op == BinaryOp::NOT_EQUAL;
+                return total && is_pure(expr.left) && is_pure(expr.right);
+            },
+            [](const auto&) { return false; },
+        },
+        ast.expr(id));
+}
+
+bool Optimizer::terminates(const StmtId id) const {
+    if(id == StmtId::NONE)
+        return false;
+    return std::visit(
+        overloaded{
+            [](const ReturnStmt&) { return true; },
+            [](const BreakStmt&) { return true; },
+            [](const ContinueStmt&) { return true; },
+            [this](const BlockStmt& stmt) {
+                return std::ranges::any_of(ast.list(stmt.statements), [this](const StmtId inner) {
+                    return terminates(inner);
+                });
+            },
+            [this](const IfStmt& stmt) { return terminates(stmt.then_branch) && terminates(stmt.else_branch); },
+            [](const auto&) { return false; },
+        },
+        ast.stmt(id));
+}
+
+size_t Optimizer::count(const StmtId id) const {
+    if(id == StmtId::NONE)
+        return 0;
+    return 1 + std::visit(
+                   overloaded{
+                       [this](const ExprStmt& stmt) { return count(stmt.expr); },
+                       [this](const IfStmt& stmt) {
+                           return count(stmt.condition) + count(stmt.then_branch) + count(stmt.else_branch);
+                       },
+                       [this](const VarDeclStmt& stmt) { return count(stmt.initializer); },
+                       [this](const FuncDeclStmt& stmt) { return count(stmt.body); },
+                       [this](const BlockStmt& stmt) {
+                           size_t nodes = 0;
+                           for(const auto inner : ast.list(stmt.statements))
+                               nodes += count(inner);
+                           return nodes;
+                       },
+                       [this](const WhileStmt& stmt) { return count(stmt.condition) + count(stmt.body); },
+                       [this](const ReturnStmt& stmt) { return count(stmt.value); },
+                       [](const auto&) { return size_t{0}; },
+                   },
+                   ast.stmt(id));
+}
+
+size_t Optimizer::count(const ExprId id) const {
+    if(id == ExprId::NONE)
+        return 0;
+    return 1 + std::visit(
+                   overloaded{
+                       [this](const Binary& expr) { return count(expr.left) + count(expr.right); },
+                       [this](const Logical& expr) { return count(expr.left) + count(expr.right); },
+                       [this](const Unary& expr) { return count(expr.right); },
+                       [this](const Grouping& expr) { return count(expr.expr); },
+                       [this](const Assign& expr) { return count(expr.value); },
+                       [this](const Call& expr) {
+                           size_t nodes = count(expr.callee);
+                           for(const auto arg : ast.list(expr.args))
+                               nodes += count(arg);
+                           return nodes;
+                       },
+                       [this](const Lambda& expr) { return count(expr.body); },
+                       [](const auto&) { return size_t{0}; },
+                   },
+                   ast.expr(id));
+}
+
+size_t Optimizer::count(const BodyId id) const {
+    size_t nodes = 0;
+    if(const auto& body = ast.body(id); !body.deferred && !body.ast) {
+        for(const auto stmt : ast.list(body.statements))
+            nodes += count(stmt);
+    }
+    return nodes;
+}
@@ -0,0 +1,109 @@
+#include "interpreter/scanner.hpp"
+
+#include "const/characters.hpp"
+#include "types/error_code.hpp"
+
+#include <algorithm>
+#include <thread>
+
+std::vector<size_t> Scanner::chunk_bounds(const std::string_view source, const size_t count) {
+    std::vector<size_t> bounds{0};
+    const size_t        step = source.size() / std::max<size_t>(count, 1);
+    while(bounds.size() < count) {
+        // Cut right after the first newline past the ideal cut, so no lexeme other than a string spans two chunks
+        const size_t cut = source.find(delimiter::NEWLINE, bounds.back() + step);
+        if(cut == std::string_view::npos || cut + 1 >= source.size())
+            break;
+        bounds.push_back(cut + 1);
+    }
+    bounds.push_back(source.size());
+    return bounds;
+}
+
+Scanner::ChunkScan Scanner::scan_chunk(const std::string_view source, const size_t begin, const size_t end) {
+    auto scanner = from_source(source.substr(begin, end - begin));
+    auto result  = ChunkScan{};
+    while(scanner.ahead() != delimiter::ENDOF) {
+        scanner.scan_lexeme();
+        if(scanner.has_token) {
+            result.tokens.push_back(scanner.token);
+            scanner.has_token = false;
+        }
+    }
+
+    if(scanner.j + 1 < static_cast<int>(scanner.source.size()))
+        result.end = ChunkEnd::HALTED;
+    else if(end < source.size() && !scanner.errors.empty() &&
+            scanner.errors.back().code == err::UNTERMINATED_STRING) {
+        // The string only looks unterminated because the chunk ends, its start is where the fix-up resumes
+        result.end         = ChunkEnd::OPEN_STRING;
+        result.open_string = begin + scanner.i;
+        scanner.errors.pop_back();
+    }
+    result.errors   = std::move(scanner.errors);
+    result.newlines = scanner.line - 1;
+    return result;
+}
+
+ScanResult Scanner::scan_parallel(const std::string_view source, const unsigned workers) {
+    const size_t count  = std::clamp<size_t>(source.size() / PARALLEL_MIN_CHUNK, 1, std::max(workers, 1u));
+    const auto   bounds = chunk_bounds(source, count);
+
+    std::vector<ChunkScan> chunks(bounds.size() - 1);
+    {
+        std::vector<std::jthread> pool;
+        for(size_t k = 0; k < chunks.size(); k++)
+            pool.emplace_back([&, k] { chunks[k] = scan_chunk(source, bounds[k], bounds[k + 1]); });
+    }
+
+    // Fix-up pass: chunks are appended in order with their lines shifted by the lines counted before them.
+    // When a string runs past a chunk edge, scanning resumes sequentially from the string
+    // until it lands on a chunk start between two lexemes, whose speculative scan is then valid again.
+    std::vector<Token> tokens;
+    auto               stitched = from_source(source);
+    int                line     = 1;
+    size_t             k        = 0;
+    while(k < chunks.size()) {
+        auto& chunk = chunks[k];
+        for(auto& token : chunk.tokens) {
+            token.line += line - 1;
+            tokens.push_back(token);
+        }
+        for(auto& [code, message, error_line] : chunk.errors)
+            stitched.collect_err(code, std::move(message), error_line + line - 1);
+        line += chunk.newlines;
+
+        if(chunk.end == ChunkEnd::HALTED)
+            break;
+        if(chunk.end == ChunkEnd::CLEAN) {
+            k++;
+            continue;
+        }
+
+        auto   resume = from_source(source);
+        resume.j      = static_cast<int>(chunk.open_string) - 1;
+        resume.line   = line;
+        size_t next   = k + 1;
+        bool   landed = false;
+        while(!landed && resume.ahead() != delimiter::ENDOF) {
+            resume.scan_lexeme();
+            if(resume.has_token) {
+                tokens.push_back(resume.token);
+                resume.has_token = false;
+            }
+            const auto position = static_cast<size_t>(resume.j + 1);
+            while(next < chunks.size() && bounds[next] < position)
+                next++;
+            landed = next < chunks.size() && bounds[next] == position;
+        }
+        for(auto& [code, message, error_line] : resume.errors)
+            stitched.collect_err(code, std::move(message), error_line);
+        line = resume.line;
+        if(!landed)
+            break;
+        k = next;
+    }
+
+    tokens.push_back(Token{.type = TokenType::END, .lexeme = {}, .literal = nullptr, .line = line});
+    return {std::move(tokens), stitched.collected_errors()};
+}
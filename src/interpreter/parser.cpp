@@ -1,7 +1,8 @@
 #include "interpreter/parser.hpp"
+#include "interpreter/scanner.hpp"
 
-#include <bits/ranges_algo.h>
-
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <utility>
 
@@ -11,22 +12,155 @@
 #include "utils/errorx.hpp"
 #include "utils/validation.hpp"
 
+namespace {
+
+enum class InfixKind : uint8_t {
+    NONE,
+    BINARY,
+    LOGICAL,
+    ASSIGN,
+    CALL,
+};
+
+struct InfixRule {
+    Precedence precedence = Precedence::NONE;
+    InfixKind  kind       = InfixKind::NONE;
+    BinaryOp   binary     = BinaryOp::ADD;
+    LogicalOp  logical    = LogicalOp::AND;
+};
+
+/* Operators that may follow an operand, anything else ends the expression */
+constexpr std::array<InfixRule, static_cast<size_t>(TokenType::END) + 1> INFIX_RULES = [] {
+    std::array<InfixRule, static_cast<size_t>(TokenType::END) + 1> table{};
+    const auto at = [&table](const TokenType type) -> InfixRule& { return table[static_cast<size_t>(type)]; };
+
+    const std::pair<TokenType, BinaryOp> equality[] = {
+        {TokenType::BANG_EQUAL, BinaryOp::NOT_EQUAL},
+        {TokenType::EQUAL_EQUAL, BinaryOp::EQUAL},
+    };
+    const std::pair<TokenType, BinaryOp> comparison[] = {
+        {TokenType::GREATER, BinaryOp::GREATER},
+        {TokenType::GREATER_EQUAL, BinaryOp::GREATER_EQUAL},
+        {TokenType::LESS, BinaryOp::LESS},
+        {TokenType::LESS_EQUAL, BinaryOp::LESS_EQUAL},
+    };
+    const std::pair<TokenType, BinaryOp> term[] = {
+        {TokenType::MINUS, BinaryOp::SUBTRACT},
+        {TokenType::PLUS, BinaryOp::ADD},
+    };
+    const std::pair<TokenType, BinaryOp> factor[] = {
+        {TokenType::SLASH, BinaryOp::DIVIDE},
+        {TokenType::STAR, BinaryOp::MULTIPLY},
+        {TokenType::PERCENT, BinaryOp::MODULO},
+    };
+    for(const auto& [type, op] : equality)
+        at(type) = {.precedence = Precedence::EQUALITY, .kind = InfixKind::BINARY, .binary = op};
+    for(const auto& [type, op] : comparison)
+        at(type) = {.precedence = Precedence::COMPARISON, .kind = InfixKind::BINARY, .binary = op};
+    for(const auto& [type, op] : term)
+        at(type) = {.precedence = Precedence::TERM, .kind = InfixKind::BINARY, .binary = op};
+    for(const auto& [type, op] : factor)
+        at(type) = {.precedence = Precedence::FACTOR, .kind = InfixKind::BINARY, .binary = op};
+
+    at(TokenType::OR)         = {.precedence = Precedence::OR, .kind = InfixKind::LOGICAL, .logical = LogicalOp::OR};
+    at(TokenType::AND)        = {.precedence = Precedence::AND, .kind = InfixKind::LOGICAL, .logical = LogicalOp::AND};
+    at(TokenType::EQUAL)      = {.precedence = Precedence::ASSIGNMENT, .kind = InfixKind::ASSIGN};
+    at(TokenType::LEFT_PAREN) = {.precedence = Precedence::CALL, .kind = InfixKind::CALL};
+    return table;
+}();
+
+constexpr const InfixRule& infix_rule(const TokenType type) {
+    return INFIX_RULES[static_cast<size_t>(type)];
+}
+
+static_assert(infix_rule(TokenType::STAR).precedence > infix_rule(TokenType::PLUS).precedence);
+static_assert(infix_rule(TokenType::AND).precedence > infix_rule(TokenType::OR).precedence);
+static_assert(infix_rule(TokenType::SEMICOLON).kind == InfixKind::NONE);
+
+/* Binary and logical operators are left associative, their right operand binds one level tighter */
+constexpr Precedence tighter(const Precedence precedence) {
+    return static_cast<Precedence>(static_cast<uint8_t>(precedence) + 1);
+}
+
+} // namespace
+
 void Parser::panic(const int err_code, const std::string& message, const int line) {
     throw err::make(err_code, message, line);
 }
 
-Parser Parser::from_tokens(const std::vector<Token>& tokens) {
+Token TokenList::next_token() {
+    if(next < tokens.size() - 1)
+        return tokens[next++];
+    return tokens.back();
+}
+
+Parser Parser::from_tokens(std::vector<Token> tokens) {
+    auto instance         = Parser();
+    instance.owned_source = std::make_unique<TokenList>(std::move(tokens));
+    instance.source       = instance.owned_source.get();
+    return instance;
+}
+
+Parser Parser::from_source(TokenSource& source) {
     auto instance   = Parser();
-    instance.tokens = tokens;
+    instance.source = &source;
     return instance;
 }
 
+Parser Parser::from_source(TokenSource& source, std::shared_ptr<Ast> ast) {
+    auto instance = from_source(source);
+    instance.ast  = std::move(ast);
+    return instance;
+}
+
+void Parser::defer_bodies(const std::string_view source) {
+    deferred_source = source;
+    scratch         = std::make_shared<Ast>();
+}
+
+std::pair<const Ast*, std::span<const StmtId>> Parser::function_body(const Ast& ast, const BodyId id) {
+    const auto& body = ast.body(id);
+    if(body.deferred) {
+        // Same tokens and loop depth as when the body was validated, so this parse cannot fail
+        auto scanner      = Scanner::from_source(body.source, body.offset, body.line);
+        auto parser       = from_source(scanner);
+        parser.loop_depth = body.loop_depth;
+        parser.quiet      = true;
+        parser.defer_bodies(body.source);
+        body.statements = parser.block();
+        body.ast        = std::move(parser.ast);
+        body.deferred   = false;
+    }
+    const Ast& code = body.ast ? *body.ast : ast;
+    return {&code, code.list(body.statements)};
+}
+
+void Parser::warn(const Error& warning) const {
+    if(!quiet)
+        printer::print_waring(warning);
+}
+
 bool Parser::success() const {
     return errors.empty();
 }
 
-Token Parser::current() {
-    return tokens[i];
+const std::vector<Error>& Parser::collected_errors() const {
+    return errors;
+}
+
+StmtId Parser::next_declaration() {
+    return declaration();
+}
+
+const Token& Parser::peek() {
+    return current();
+}
+
+const Token& Parser::current() {
+    // Pull lazily, the token after the current one is never needed
+    if(pulled <= i)
+        window[pulled++ % WINDOW] = source->next_token();
+    return window[i % WINDOW];
 }
 
 bool Parser::is_end() {
@@ -61,19 +195,19 @@ void Parser::synchronize() {
     }
 }
 
-Token Parser::previous() {
+const Token& Parser::previous() {
     if(i == 0)
         return current();
-    return tokens[i - 1];
+    return window[(i - 1) % WINDOW];
 }
 
-Token Parser::consume(const TokenType type, const int err_code, const std::string& message) {
+const Token& Parser::consume(const TokenType type, const int err_code, const std::string& message) {
     if(!match(type))
         panic(err_code, message, current().line);
     return previous();
 }
 
-Token Parser::advance() {
+const Token& Parser::advance() {
     if(!is_end())
         i++;
     return previous();
@@ -93,26 +227,21 @@ bool Parser::match(const TokenType type) {
     return false;
 }
 
-bool Parser::matches(std::vector<TokenType> types) {
-    if(std::ranges::any_of(types, [this](const auto& type) { return current().type == type; })) {
-        advance();
-        return true;
-    }
-    return false;
-}
-
 ParseResult Parser::parse() {
-    return std::make_tuple(program(), errors);
+    auto statements = program();
+    return std::make_tuple(Program{ast, std::move(statements)}, errors);
 }
 
-std::vector<Stmt> Parser::program() {
-    std::vector<Stmt> statements;
+std::vector<StmtId> Parser::program() {
+    std::vector<StmtId> statements;
     while(!is_end())
         statements.push_back(declaration());
     return statements;
 }
 
-Stmt Parser::declaration() {
+StmtId Parser::declaration() {
+    // An error thrown inside a loop skips its decrement, restore the depth so it does not leak into what follows
+    const int depth = loop_depth;
     try {
         if(match(TokenType::VAR))
             return var_declaration();
@@ -121,44 +250,47 @@ Stmt Parser::declaration() {
         return statement();
     } catch(Error& error) {
         errors.push_back(error);
+        loop_depth = depth;
         synchronize();
-        return Stmt{};
+        return ast->add(Stmt{});
     }
 }
 
-Stmt Parser::var_declaration() {
-    const Token name = consume(TokenType::IDENTIFIER, err::VAR_NAME_MISSING, "Expect variable name.");
+StmtId Parser::var_declaration() {
+    const Token& token = consume(TokenType::IDENTIFIER, err::VAR_NAME_MISSING, "Expect variable name.");
+    const Name   name{token.symbol, token.line};
 
-    Expr initializer = nullptr;
+    ExprId initializer = ExprId::NONE;
     if(match(TokenType::EQUAL))
         initializer = expression();
 
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after variable declaration.");
 
-    return VarDeclStmt{name, std::make_shared<Expr>(initializer)};
+    return ast->add(VarDeclStmt{name, initializer});
 }
 
-Stmt Parser::func_declaration() {
-    const Token name = consume(TokenType::IDENTIFIER, err::NAMED_FUNC_MISSING_NAME, "Expect function name.");
+StmtId Parser::func_declaration() {
+    const Token& token = consume(TokenType::IDENTIFIER, err::NAMED_FUNC_MISSING_NAME, "Expect function name.");
+    const Name   name{token.symbol, token.line};
     consume(TokenType::LEFT_PAREN, err::FUNC_PARAMS_MISSING_PAREN, "Expect '(' after function name.");
-    std::vector<Token> params;
+    std::vector<Name> params;
     if(!check(TokenType::RIGHT_PAREN)) {
         do {
-            auto param = consume(TokenType::IDENTIFIER, err::FUNC_PARAM_MISSING_NAME, "Expect parameter name.");
-            params.push_back(param);
+            const auto& param = consume(TokenType::IDENTIFIER, err::FUNC_PARAM_MISSING_NAME, "Expect parameter name.");
+            params.push_back(Name{param.symbol, param.line});
         } while(match(TokenType::COMMA));
     }
     if(utils::invalid_arity(params.size())) {
         const auto err = err::make(err::TOO_MANY_ARGUMENTS, "Can't have more than 255 parameters.", current().line);
-        printer::print_waring(err);
+        warn(err);
     }
     consume(TokenType::RIGHT_PAREN, err::FUNC_PARAMS_MISSING_PAREN, "Expect ')' after parameters.");
     consume(TokenType::LEFT_BRACE, err::BLOCK_NOT_CLOSED, "Expect '{' before function body.");
-    auto body = std::get<BlockStmt>(block_stmt()).statements;
-    return FuncDeclStmt{name, std::move(params), std::move(body)};
+    const auto names = ast->add_list(std::span<const Name>(params));
+    return ast->add(FuncDeclStmt{name, names, function_body()});
 }
 
-Stmt Parser::statement() {
+StmtId Parser::statement() {
     if(match(TokenType::IF))
         return if_stmt();
     if(match(TokenType::WHILE))
@@ -176,274 +308,253 @@ Stmt Parser::statement() {
     return expr_stmt();
 }
 
-Stmt Parser::if_stmt() {
+StmtId Parser::if_stmt() {
     consume(TokenType::LEFT_PAREN, err::IF_COND_MISSING_PAREN, "Expect '(' after 'if'.");
-    const auto condition = std::make_shared<Expr>(expression());
+    const auto condition = expression();
     consume(TokenType::RIGHT_PAREN, err::IF_COND_MISSING_PAREN, "Expect ')' after condition.");
-    const auto            then_branch = std::make_shared<Stmt>(statement());
-    std::shared_ptr<Stmt> else_branch = nullptr;
+    const auto then_branch = statement();
+    auto       else_branch = StmtId::NONE;
     if(match(TokenType::ELSE)) {
-        else_branch = std::make_shared<Stmt>(statement());
+        else_branch = statement();
     }
-    return IfStmt{condition, then_branch, else_branch};
+    return ast->add(IfStmt{condition, then_branch, else_branch});
 }
 
-Stmt Parser::expr_stmt() {
-    Expr value = expression();
+StmtId Parser::expr_stmt() {
+    const ExprId value = expression();
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after value.");
-    return ExprStmt{std::make_shared<Expr>(value)};
+    return ast->add(ExprStmt{value});
+}
+
+StmtId Parser::block_stmt() {
+    return ast->add(BlockStmt{block()});
+}
+
+BodyId Parser::function_body() {
+    // Bodies nested in one being validated are validated along with it
+    if(deferred_source.empty() || ast == scratch)
+        return ast->add_body(FuncBody{.statements = block()});
+
+    const Token& brace = previous();
+    auto         body  = FuncBody{
+                 .deferred   = true,
+                 .source     = deferred_source,
+                 .offset     = static_cast<size_t>(brace.lexeme.data() - deferred_source.data()) + 1,
+                 .line       = brace.line,
+                 .loop_depth = loop_depth,
+    };
+    const auto owner = std::exchange(ast, scratch);
+    try {
+        block();
+    } catch(Error&) {
+        ast = owner;
+        scratch->clear();
+        throw;
+    }
+    ast = owner;
+    scratch->clear();
+    return ast->add_body(std::move(body));
 }
 
-Stmt Parser::block_stmt() {
-    std::vector<std::shared_ptr<Stmt>> statements;
+NodeList<StmtId> Parser::block() {
+    std::vector<StmtId> statements;
     while(!check(TokenType::RIGHT_BRACE) && !is_end())
-        statements.push_back(std::make_shared<Stmt>(declaration()));
+        statements.push_back(declaration());
     consume(TokenType::RIGHT_BRACE, err::BLOCK_NOT_CLOSED, "Expect '}' after block.");
-    return BlockStmt{statements};
+    return ast->add_list(std::span<const StmtId>(statements));
 }
 
-Stmt Parser::while_stmt() {
+StmtId Parser::while_stmt() {
     loop_depth++;
     consume(TokenType::LEFT_PAREN, err::WHILE_COND_MISSING_PAREN, "Expect '(' after 'while'.");
-    Expr condition = expression();
+    const ExprId condition = expression();
     consume(TokenType::RIGHT_PAREN, err::WHILE_COND_MISSING_PAREN, "Expect ')' after condition.");
-    Stmt body = statement();
+    const StmtId body = statement();
     loop_depth--;
-    return WhileStmt{std::make_shared<Expr>(condition), std::make_shared<Stmt>(body)};
+    return ast->add(WhileStmt{condition, body});
 }
 
-Stmt Parser::for_stmt() {
+StmtId Parser::for_stmt() {
+    const int line = previous().line;
     consume(TokenType::LEFT_PAREN, err::FOR_COND_MISSING_PAREN, "Expect '(' after 'for'.");
 
-    std::shared_ptr<Stmt> initializer = nullptr;
+    auto initializer = StmtId::NONE;
     if(match(TokenType::VAR))
-        initializer = std::make_shared<Stmt>(var_declaration());
+        initializer = var_declaration();
     else if(!match(TokenType::SEMICOLON))
-        initializer = std::make_shared<Stmt>(expr_stmt());
+        initializer = expr_stmt();
 
-    auto condition = std::make_shared<Expr>(Literal{true});
+    auto condition = ExprId::NONE;
     if(!check(TokenType::SEMICOLON))
-        condition = std::make_shared<Expr>(expression());
+        condition = expression();
+    else
+        condition = ast->add(Literal{true}, line);
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after loop condition.");
 
-    std::shared_ptr<Expr> increment = nullptr;
+    auto increment = ExprId::NONE;
     if(!check(TokenType::RIGHT_PAREN))
-        increment = std::make_shared<Expr>(expression());
+        increment = expression();
 
     consume(TokenType::RIGHT_PAREN, err::FOR_COND_MISSING_PAREN, "Expect ')' after for clauses.");
 
-    Stmt stmt = statement();
+    StmtId stmt = statement();
 
-    if(increment != nullptr)
-        stmt = BlockStmt{{std::make_shared<Stmt>(stmt), std::make_shared<Stmt>(ExprStmt{increment})}};
+    if(increment != ExprId::NONE) {
+        const StmtId body[] = {stmt, ast->add(ExprStmt{increment})};
+        stmt                = ast->add(BlockStmt{ast->add_list(std::span<const StmtId>(body))});
+    }
 
     // desugaring for loop to while loop, so we don't need to keep track of the loop depth
-    stmt = WhileStmt{condition, std::make_shared<Stmt>(stmt)};
-    if(initializer != nullptr)
-        stmt = BlockStmt{{initializer, std::make_shared<Stmt>(stmt)}};
+    stmt = ast->add(WhileStmt{condition, stmt});
+    if(initializer != StmtId::NONE) {
+        const StmtId block[] = {initializer, stmt};
+        stmt                 = ast->add(BlockStmt{ast->add_list(std::span<const StmtId>(block))});
+    }
 
     return stmt;
 }
 
-Stmt Parser::break_stmt() {
+StmtId Parser::break_stmt() {
     if(loop_depth == 0)
         panic(err::BREAK_OUTSIDE_LOOP, "Break statement can only be used inside a loop.", current().line);
 
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after 'break'.");
-    return BreakStmt{};
+    return ast->add(BreakStmt{});
 }
 
-Stmt Parser::continue_stmt() {
+StmtId Parser::continue_stmt() {
     if(loop_depth == 0)
         panic(err::CONTINUE_OUTSIDE_LOOP, "Continue statement can only be used inside a loop.", current().line);
 
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after 'continue'.");
-    return ContinueStmt{};
+    return ast->add(ContinueStmt{});
 }
 
-Stmt Parser::return_stmt() {
-    Expr value = nullptr;
+StmtId Parser::return_stmt() {
+    auto value = ExprId::NONE;
     if(!check(TokenType::SEMICOLON))
         value = expression();
     consume(TokenType::SEMICOLON, err::SEMICOLON_MISSING, "Expect ';' after return value.");
-    return ReturnStmt{std::make_shared<Expr>(value)};
-}
-
-Expr Parser::expression() {
-    return assignment();
-}
-
-Expr Parser::assignment() {
-    Expr expr = logical_or();
-
-    if(match(TokenType::EQUAL)) {
-        Token equals = previous();
-        Expr  value  = assignment();
-
-        if(std::holds_alternative<Variable>(expr)) {
-            const Token name = std::get<Variable>(expr).name;
-            return Assign{name, std::make_shared<Expr>(value)};
+    return ast->add(ReturnStmt{value});
+}
+
+ExprId Parser::expression() {
+    return parse_precedence(Precedence::ASSIGNMENT);
+}
+
+ExprId Parser::parse_precedence(const Precedence min) {
+    ExprId expr = unary();
+
+    // A token without an infix rule has NONE precedence, which is below any `min` and ends the loop
+    while(infix_rule(current().type).precedence >= min) {
+        const auto& rule = infix_rule(current().type);
+        const int   line = advance().line;
+
+        switch(rule.kind) {
+        case InfixKind::ASSIGN:
+            expr = assignment(expr);
+            break;
+        case InfixKind::CALL:
+            expr = arguments(expr);
+            break;
+        case InfixKind::LOGICAL: {
+            const ExprId right = parse_precedence(tighter(rule.precedence));
+            expr               = ast->add(
+                Logical{
+                    .left  = expr,
+                    .op    = rule.logical,
+                    .right = right,
+                },
+                line);
+            break;
+        }
+        default: {
+            const ExprId right = parse_precedence(tighter(rule.precedence));
+            expr               = ast->add(
+                Binary{
+                    .left  = expr,
+                    .op    = rule.binary,
+                    .right = right,
+                },
+                line);
+            break;
+        }
         }
-        throw Error(err::INVALID_ASSIGNMENT_TARGET, "Invalid assignment target.");
-    }
-
-    return expr;
-}
-
-Expr Parser::logical_or() {
-    Expr expr = logical_and();
-
-    while(match(TokenType::OR)) {
-        const Token op    = previous();
-        Expr        right = logical_and();
-
-        expr = Logical{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
-    }
-
-    return expr;
-}
-
-Expr Parser::logical_and() {
-    Expr expr = equality();
-
-    while(match(TokenType::AND)) {
-        const Token op    = previous();
-        Expr        right = equality();
-
-        expr = Logical{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
-    }
-
-    return expr;
-}
-
-Expr Parser::equality() {
-    Expr expr = comparison();
-
-    while(matches({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-        const Token op    = previous();
-        Expr        right = comparison();
-
-        expr = Binary{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
     }
 
     return expr;
 }
 
-Expr Parser::comparison() {
-    Expr expr = term();
-    while(matches({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
-        const Token op    = previous();
-        Expr        right = term();
+ExprId Parser::assignment(const ExprId target) {
+    // Right associative, the value may itself be an assignment
+    const ExprId value = parse_precedence(Precedence::ASSIGNMENT);
 
-        expr = Binary{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
-    }
-    return expr;
+    if(const auto* variable = std::get_if<Variable>(&ast->expr(target)))
+        return ast->add(Assign{variable->name, value}, ast->line(target));
+    throw Error(err::INVALID_ASSIGNMENT_TARGET, "Invalid assignment target.");
 }
 
-Expr Parser::term() {
-    Expr expr = factor();
-    while(matches({TokenType::MINUS, TokenType::PLUS})) {
-        const Token op    = previous();
-        Expr        right = factor();
+ExprId Parser::unary() {
+    if(check(TokenType::BANG) || check(TokenType::MINUS)) {
+        const Token& op    = advance();
+        const auto   kind  = op.type == TokenType::BANG ? UnaryOp::NOT : UnaryOp::NEGATE;
+        const int    line  = op.line;
+        const ExprId right = parse_precedence(Precedence::UNARY);
 
-        expr = Binary{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
+        return ast->add(
+            Unary{
+                .op    = kind,
+                .right = right,
+            },
+            line);
     }
-    return expr;
+    return primary();
 }
 
-Expr Parser::factor() {
-    Expr expr = unary();
-    while(matches({TokenType::SLASH, TokenType::STAR, TokenType::PERCENT})) {
-        const Token op    = previous();
-        Expr        right = unary();
-
-        expr = Binary{
-            .left  = std::make_shared<Expr>(expr),
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
-    }
-    return expr;
-}
-
-Expr Parser::unary() {
-    if(matches({TokenType::BANG, TokenType::MINUS})) {
-        const Token op    = previous();
-        Expr        right = unary();
-
-        return Unary{
-            .op    = op,
-            .right = std::make_shared<Expr>(right),
-        };
-    }
-    return call();
-}
-
-Expr Parser::call() {
-    Expr expr = primary();
-    while(match(TokenType::LEFT_PAREN)) {
-        expr = arguments(std::make_shared<Expr>(expr));
-    }
-    return expr;
-}
-
-Expr Parser::arguments(std::shared_ptr<Expr> callee) {
-    std::vector<std::shared_ptr<Expr>> args;
+ExprId Parser::arguments(const ExprId callee) {
+    std::vector<ExprId> args;
     if(!check(TokenType::RIGHT_PAREN)) {
         do {
-            args.push_back(std::make_shared<Expr>(expression()));
+            args.push_back(expression());
         } while(match(TokenType::COMMA));
     }
     if(utils::invalid_arity(args.size())) {
         const auto err = err::make(err::TOO_MANY_ARGUMENTS, "Can't have more than 255 arguments.", current().line);
-        printer::print_waring(err);
+        warn(err);
     }
-    auto paren = consume(TokenType::RIGHT_PAREN, err::CALL_NOT_CLOSED, "Expect ')' after arguments.");
-    return Call{std::move(callee), std::move(paren), std::move(args)};
+    const int line = consume(TokenType::RIGHT_PAREN, err::CALL_NOT_CLOSED, "Expect ')' after arguments.").line;
+    return ast->add(Call{callee, ast->add_list(std::span<const ExprId>(args))}, line);
 }
 
-Expr Parser::primary() {
+ExprId Parser::primary() {
     if(match(TokenType::FALSE))
-        return Literal{false};
+        return ast->add(Literal{false}, previous().line);
     if(match(TokenType::TRUE))
-        return Literal{true};
+        return ast->add(Literal{true}, previous().line);
     if(match(TokenType::NIL))
-        return Literal{nullptr};
+        return ast->add(Literal{nullptr}, previous().line);
 
-    if(matches({TokenType::NUMBER, TokenType::STRING}))
-        return Literal{previous().literal};
+    if(match(TokenType::NUMBER))
+        return ast->add(Literal{previous().literal}, previous().line);
+
+    // Strip the surrounding quotes, this is the first time the string gets its own storage
+    if(match(TokenType::STRING)) {
+        const auto lexeme = previous().lexeme;
+        return ast->add(Literal{ast->add_string(lexeme.substr(1, lexeme.size() - 2))}, previous().line);
+    }
 
     if(match(TokenType::LEFT_PAREN)) {
-        Expr expr = expression();
+        const int    line = previous().line;
+        const ExprId expr = expression();
         consume(TokenType::RIGHT_PAREN, err::EXPR_NOT_CLOSED, "Error at ')': Expect expression.");
-        return Grouping{std::make_shared<Expr>(expr)};
+        return ast->add(Grouping{expr}, line);
     }
 
     if(match(TokenType::ARROW))
         return lambda();
 
     if(match(TokenType::IDENTIFIER))
-        return Variable{previous()};
+        return ast->add(Variable{previous().symbol}, previous().line);
 
     // The parsing process is designed to always decades the expression to the lowest level
     // That's mean if the parser can not detect any primary expression, it will be an error.
@@ -451,21 +562,22 @@ Expr Parser::primary() {
     throw Error(err::UNKNOWN_PARSING_ERROR, "Parsing progress reached to an unknown state.");
 }
 
-Expr Parser::lambda() {
+ExprId Parser::lambda() {
+    const int line = previous().line;
     consume(TokenType::LEFT_PAREN, err::FUNC_PARAMS_MISSING_PAREN, "Expect '(' after 'lambda'.");
-    std::vector<Token> params;
+    std::vector<Name> params;
     if(!check(TokenType::RIGHT_PAREN)) {
         do {
-            auto param = consume(TokenType::IDENTIFIER, err::FUNC_PARAM_MISSING_NAME, "Expect parameter name.");
-            params.push_back(param);
+            const auto& param = consume(TokenType::IDENTIFIER, err::FUNC_PARAM_MISSING_NAME, "Expect parameter name.");
+            params.push_back(Name{param.symbol, param.line});
         } while(match(TokenType::COMMA));
     }
     if(utils::invalid_arity(params.size())) {
         const auto err = err::make(err::TOO_MANY_ARGUMENTS, "Can't have more than 255 parameters.", current().line);
-        printer::print_waring(err);
+        warn(err);
     }
     consume(TokenType::RIGHT_PAREN, err::FUNC_PARAMS_MISSING_PAREN, "Expect ')' after parameters.");
     consume(TokenType::LEFT_BRACE, err::BLOCK_NOT_CLOSED, "Expect '{' before lambda body.");
-    auto body = std::get<BlockStmt>(block_stmt()).statements;
-    return Lambda{std::move(params), std::move(body)};
-}
\ No newline at end of file
+    const auto names = ast->add_list(std::span<const Name>(params));
+    return ast->add(Lambda{names, function_body()}, line);
+}
@@ -0,0 +1,199 @@
+#include "interpreter/resolver.hpp"
+
+#include "utils/templ.hpp"
+
+#include <utility>
+
+void Resolver::resolve(const Program& program) {
+    auto resolver = Resolver(*program.ast);
+    for(const auto stmt : program.statements)
+        resolver.resolve(stmt);
+}
+
+void Resolver::resolve(const FuncBody& body) {
+    auto resolver = Resolver(*body.ast);
+    resolver.body(body);
+}
+
+void Resolver::declare(Name& name) const {
+    if(!scope) {
+        name.slot = GLOBAL_SLOT;
+        return;
+    }
+    // Declaring a name twice reuses its slot, so the second declaration still fails when it runs
+    const auto [it, _] = scope->slots.try_emplace(name.symbol, static_cast<uint32_t>(scope->slots.size()));
+    name.slot          = it->second;
+}
+
+void Resolver::collect(const StmtId id) {
+    if(auto* decl = std::get_if<VarDeclStmt>(&ast.stmt(id)))
+        declare(decl->name);
+    else if(auto* func = std::get_if<FuncDeclStmt>(&ast.stmt(id)))
+        declare(func->name);
+}
+
+void Resolver::scoped(const std::span<const StmtId> statements) {
+    // Every name of the scope is known before any reference is resolved, a closure may use one declared after it
+    for(const auto stmt : statements)
+        collect(stmt);
+    for(const auto stmt : statements)
+        resolve(stmt);
+}
+
+void Resolver::function(const NodeList<Name> params, const BodyId id) {
+    // The closure holds on to every scope it is created in, up to the globals
+    for(Scope* current = scope.get(); current && !current->captured; current = current->parent.get())
+        current->captured = true;
+    const auto enclosing = std::exchange(scope, std::make_shared<Scope>(Scope{.parent = scope}));
+    for(auto& param : ast.list(params))
+        declare(param);
+    const auto& code = ast.body(id);
+    code.scope       = std::exchange(scope, enclosing);
+    if(!code.deferred)
+        body(code);
+}
+
+void Resolver::body(const FuncBody& code) {
+    const auto enclosing = std::exchange(scope, std::move(code.scope));
+    scoped(ast.list(code.statements));
+    const auto statements = ast.list(code.statements);
+    for(size_t k = 0; k < statements.size(); k++)
+        tail(statements[k], k + 1 == statements.size());
+    code.slots    = static_cast<uint32_t>(scope->slots.size());
+    code.captured = scope->captured;
+    code.resolved = true;
+    scope         = enclosing;
+}
+
+void Resolver::tail(const StmtId id, const bool last) {
+    if(id == StmtId::NONE)
+        return;
+    // A return always ends the function, other statements only give its value when they run last
+    std::visit(
+        overloaded{
+            [&](const ExprStmt& stmt) {
+                if(last)
+                    tail(stmt.expr);
+            },
+            [&](const IfStmt& stmt) {
+                tail(stmt.then_branch, last);
+                tail(stmt.else_branch, last);
+            },
+            [&](const BlockStmt& stmt) {
+                const auto statements = ast.list(stmt.statements);
+                for(size_t k = 0; k < statements.size(); k++)
+                    tail(statements[k], last && k + 1 == statements.size());
+            },
+            [&](const WhileStmt& stmt) { tail(stmt.body, false); },
+            [&](const ReturnStmt& stmt) { tail(stmt.value); },
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+void Resolver::tail(const ExprId id) {
+    if(id == ExprId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](const Grouping& expr) { tail(expr.expr); },
+            [this](const Logical& expr) { tail(expr.right); },
+            [](Call& expr) { expr.tail = true; },
+            [](const auto&) {},
+        },
+        ast.expr(id));
+}
+
+void Resolver::resolve(const StmtId id) {
+    if(id == StmtId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](const ExprStmt& stmt) { resolve(stmt.expr); },
+            [this](const IfStmt& stmt) {
+                resolve(stmt.condition);
+                resolve(stmt.then_branch);
+                resolve(stmt.else_branch);
+            },
+            [this](const VarDeclStmt& stmt) { resolve(stmt.initializer); },
+            [this](const FuncDeclStmt& stmt) { function(stmt.params, stmt.body); },
+            [this](BlockStmt& stmt) {
+                const auto enclosing = std::exchange(scope, std::make_shared<Scope>(Scope{.parent = scope}));
+                scoped(ast.list(stmt.statements));
+                stmt.slots    = static_cast<uint32_t>(scope->slots.size());
+                stmt.captured = scope->captured;
+                scope         = enclosing;
+            },
+            [this](WhileStmt& stmt) {
+                // Values hoisted out of the loop live in a scope around it, holding nothing else
+                const auto enclosing = scope;
+                if(stmt.hoisted.size != 0) {
+                    scope = std::make_shared<Scope>(Scope{.parent = scope});
+                    for(auto& name : ast.list(stmt.hoisted))
+                        declare(name);
+                }
+                resolve(stmt.condition);
+                resolve(stmt.body);
+                stmt.captured = stmt.hoisted.size != 0 && scope->captured;
+                scope         = enclosing;
+            },
+            [this](const ReturnStmt& stmt) { resolve(stmt.value); },
+            [](const auto&) {},
+        },
+        ast.stmt(id));
+}
+
+void Resolver::resolve(const ExprId id) {
+    if(id == ExprId::NONE)
+        return;
+    std::visit(
+        overloaded{
+            [this](const Binary& expr) {
+                resolve(expr.left);
+                resolve(expr.right);
+            },
+            [this](const Logical& expr) {
+                resolve(expr.left);
+                resolve(expr.right);
+            },
+            [this](const Unary& expr) { resolve(expr.right); },
+            [this](const Grouping& expr) { resolve(expr.expr); },
+            [this](Variable& expr) { expr.coords = coords(expr.name); },
+            [this](Assign& expr) {
+                resolve(expr.value);
+                expr.coords = coords(expr.name);
+            },
+            [this](const Call& expr) {
+                resolve(expr.callee);
+                for(const auto arg : ast.list(expr.args))
+                    resolve(arg);
+            },
+            [this](const Lambda& expr) { function(expr.params, expr.body); },
+            [this](Hoisted& expr) {
+                resolve(expr.expr);
+                expr.coord = coord(expr.name);
+            },
+            // Literals, and nodes the Inliner only adds once the program is resolved
+            [](const auto&) {},
+        },
+        ast.expr(id));
+}
+
+Coord Resolver::coord(const Symbol name) const {
+    uint32_t depth = 0;
+    for(const Scope* current = scope.get(); current; current = current->parent.get(), depth++) {
+        if(const auto it = current->slots.find(name); it != current->slots.end())
+            return {depth, it->second};
+    }
+    return {};
+}
+
+NodeList<Coord> Resolver::coords(const Symbol name) {
+    found.clear();
+    uint32_t depth = 0;
+    for(const Scope* current = scope.get(); current; current = current->parent.get(), depth++) {
+        if(const auto it = current->slots.find(name); it != current->slots.end())
+            found.push_back({depth, it->second});
+    }
+    return ast.add_list(std::span<const Coord>(found));
+}
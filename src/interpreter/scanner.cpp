@@ -1,24 +1,41 @@
 #include "interpreter/scanner.hpp"
 
 #include "const/characters.hpp"
+#include "const/lexicon.hpp"
 #include "types/error_code.hpp"
 #include "types/token_t.hpp"
-#include "utils/validation.hpp"
+#include "utils/errorx.hpp"
+#include "utils/number.hpp"
+#include "utils/simd_scan.hpp"
 
 #include <iostream>
 
-Scanner Scanner::from_source(const std::string& source) {
+Scanner Scanner::from_source(const std::string_view source) {
     auto instance   = Scanner();
     instance.source = source;
     return instance;
 }
 
+Scanner Scanner::from_source(const std::string_view source, const size_t offset, const int line) {
+    auto instance = from_source(source);
+    instance.j    = static_cast<int>(offset) - 1;
+    instance.line = line;
+    return instance;
+}
+
 bool Scanner::success() const {
     return errors.empty();
 }
 
+std::vector<Error> Scanner::collected_errors() const {
+    std::vector<Error> result;
+    for(const auto& [code, message, line] : errors)
+        result.push_back(err::make(code, message, line));
+    return result;
+}
+
 void Scanner::collect_err(const int err_code, std::string message, const int line) {
-    errors.emplace_back(err_code, std::format("[line {}] {}", line, message));
+    errors.push_back({err_code, std::move(message), line});
 }
 
 bool Scanner::is_eof(const int index) const {
@@ -56,28 +73,25 @@ void Scanner::scan_next() {
 }
 
 void Scanner::add_token(const TokenType type, const Literal& literal) {
-    const auto token = Token{
+    token = Token{
         .type    = type,
-        .lexeme  = type == TokenType::END ? EMPTY : source.substr(i, j - i + 1),
+        .lexeme  = type == TokenType::END ? std::string_view() : source.substr(i, j - i + 1),
         .literal = literal,
         .line    = line,
     };
-    tokens.push_back(token);
+    has_token = true;
 }
 
 void Scanner::handle_slash() {
-    // Skip comment
+    // Skip comment, the newline is left for the main loop to count
     if(ahead_match(symbol::Slash)) {
-        while(ahead() != delimiter::NEWLINE && ahead() != delimiter::ENDOF)
-            advance();
+        j = static_cast<int>(utils::skip_to_line_end(source, j + 1)) - 1;
     } else
         add_token(TokenType::SLASH);
 }
 
 void Scanner::handle_string() {
-    while(ahead() != surround::DoubleQuote && ahead() != delimiter::ENDOF) {
-        scan_next();
-    }
+    j = static_cast<int>(utils::skip_to_quote(source, j + 1)) - 1;
 
     if(ahead() == delimiter::ENDOF) {
         collect_err(err::UNTERMINATED_STRING, "Unterminated string.", line);
@@ -85,126 +99,79 @@ void Scanner::handle_string() {
     }
 
     scan_next();
-    const std::string str = source.substr(i + 1, j - i - 1);
-    add_token(TokenType::STRING, str);
+    // The literal is materialized by the parser, the token only views the quoted lexeme
+    add_token(TokenType::STRING);
 }
 
 void Scanner::handle_number() {
-    while(isdigit(ahead()))
+    while(lexicon::is_digit(ahead()))
         scan_next();
-    if(ahead() == symbol::Dot && isdigit(ahead(2))) {
+    if(ahead() == symbol::Dot && lexicon::is_digit(ahead(2))) {
         scan_next();
-        while(isdigit(ahead()))
+        while(lexicon::is_digit(ahead()))
             scan_next();
     }
-    const std::string str = source.substr(i, j - i + 1);
-    double            val = std::stod(str);
-    add_token(TokenType::NUMBER, val);
+    add_token(TokenType::NUMBER, utils::parse_number_literal(source.substr(i, j - i + 1)));
 }
 
 void Scanner::handle_identifier() {
-    while(utils::is_identifier_char(ahead()))
-        scan_next();
+    j = static_cast<int>(utils::skip_identifier_chars(source, j + 1)) - 1;
     // Allows "?" at the end of identifiers
     if(ahead() == symbol::Question)
         scan_next();
-    if(const std::string str = source.substr(i, j - i + 1); keywords.contains(str))
-        add_token(keywords[str]);
-    else
-        add_token(TokenType::IDENTIFIER);
+    const auto lexeme = source.substr(i, j - i + 1);
+    const auto type   = lexicon::keyword_type(lexeme);
+    add_token(type);
+    if(type == TokenType::IDENTIFIER)
+        token.symbol = Symbol::intern(lexeme);
 }
 
-ScanResult Scanner::scan_tokens() {
-    while(ahead() != delimiter::ENDOF) {
-        switch(const auto c = advance()) {
-        // Count new line
-        case delimiter::NEWLINE:
-            line++;
-            break;
-        case delimiter::TAB:
-        case delimiter::SPACE:
-            break;
-
-            // Case symbol
-        case symbol::LeftParen:
-            add_token(TokenType::LEFT_PAREN);
-            break;
-        case symbol::RightParen:
-            add_token(TokenType::RIGHT_PAREN);
-            break;
-        case symbol::LeftBrace:
-            add_token(TokenType::LEFT_BRACE);
-            break;
-        case symbol::RightBrace:
-            add_token(TokenType::RIGHT_BRACE);
-            break;
-        case symbol::Plus:
-            add_token(TokenType::PLUS);
-            break;
-        case symbol::Minus:
-            if(ahead_match(op::Greater))
-                add_token(TokenType::ARROW);
-            else
-                add_token(TokenType::MINUS);
-            break;
-        case symbol::Comma:
-            add_token(TokenType::COMMA);
-            break;
-        case symbol::Dot:
-            add_token(TokenType::DOT);
-            break;
-        case symbol::Semicolon:
-            add_token(TokenType::SEMICOLON);
-            break;
-        case symbol::Star:
-            add_token(TokenType::STAR);
-            break;
-        case symbol::Slash:
-            handle_slash();
-            break;
-        case symbol::Percent:
-            add_token(TokenType::PERCENT);
-            break;
-
-        // Case operators
-        case op::Bang:
-            if(ahead_match(op::Equal))
-                add_token(TokenType::BANG_EQUAL);
-            else
-                add_token(TokenType::BANG);
-            break;
-        case op::Equal:
-            if(ahead_match(op::Equal))
-                add_token(TokenType::EQUAL_EQUAL);
-            else
-                add_token(TokenType::EQUAL);
-            break;
-        case op::Greater:
-            if(ahead_match(op::Equal))
-                add_token(TokenType::GREATER_EQUAL);
-            else
-                add_token(TokenType::GREATER);
-            break;
-        case op::Less:
-            if(ahead_match(op::Equal))
-                add_token(TokenType::LESS_EQUAL);
-            else
-                add_token(TokenType::LESS);
-            break;
-
-        case surround::DoubleQuote:
-            handle_string();
-            break;
-
-        default:
-            if(isdigit(c))
-                handle_number();
-            else if(utils::is_identifier_start(c))
-                handle_identifier();
-            else
-                collect_err(err::LEXICAL_ERROR, std::string("Unexpected character: ") + source[j], line);
-        }
+void Scanner::scan_lexeme() {
+    switch(const auto& cls = lexicon::char_class(advance()); cls.kind) {
+    // Count new line
+    case lexicon::CharKind::NEWLINE:
+        line++;
+        break;
+    case lexicon::CharKind::BLANK:
+        // Consume the whole run of blanks at once
+        j = static_cast<int>(utils::skip_blanks(source, j + 1)) - 1;
+        break;
+    case lexicon::CharKind::SINGLE:
+        add_token(cls.single);
+        break;
+    case lexicon::CharKind::PAIRED:
+        add_token(ahead_match(cls.follow) ? cls.paired : cls.single);
+        break;
+    case lexicon::CharKind::SLASH:
+        handle_slash();
+        break;
+    case lexicon::CharKind::QUOTE:
+        handle_string();
+        break;
+    case lexicon::CharKind::DIGIT:
+        handle_number();
+        break;
+    case lexicon::CharKind::IDENT_START:
+        handle_identifier();
+        break;
+    default:
+        collect_err(err::LEXICAL_ERROR, std::string("Unexpected character: ") + source[j], line);
     }
-    add_token(TokenType::END);
-    return {tokens, errors};
+}
+
+Token Scanner::next_token() {
+    while(!has_token && ahead() != delimiter::ENDOF)
+        scan_lexeme();
+    if(!has_token)
+        add_token(TokenType::END);
+    has_token = false;
+    return token;
+}
+
+ScanResult Scanner::scan_tokens() {
+    std::vector<Token> tokens;
+    do {
+        tokens.push_back(next_token());
+    } while(tokens.back().type != TokenType::END);
+    return {std::move(tokens), collected_errors()};
 }
\ No newline at end of file
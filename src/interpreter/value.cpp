@@ -0,0 +1,89 @@
+#include "interpreter/value.hpp"
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+Value::Value(std::string text) : bits(box(STRING, reinterpret_cast<uint64_t>(new String{{}, std::move(text)}))) {}
+
+Value::Value(std::shared_ptr<Callable> callable)
+    : bits(box(CALLABLE, reinterpret_cast<uint64_t>(new Function{{}, std::move(callable)}))) {}
+
+Value Value::concat(const Value& left, const Value& right) {
+    auto* l = static_cast<String*>(left.object());
+    auto* r = static_cast<String*>(right.object());
+    if(l->length + r->length <= FLAT_LENGTH)
+        return Value(left.as_string() + right.as_string());
+    if(r->length == 0)
+        return left;
+    if(l->length == 0)
+        return right;
+    l->references++;
+    r->references++;
+    return Value(new String{{}, {}, l->length + r->length, l, r});
+}
+
+size_t Value::hash() const {
+    auto* string = static_cast<String*>(object());
+    if(string->hash == 0)
+        string->hash = std::hash<std::string_view>{}(as_string());
+    return string->hash;
+}
+
+bool Value::equal_strings(const Value& left, const Value& right) {
+    const auto* l = static_cast<const String*>(left.object());
+    const auto* r = static_cast<const String*>(right.object());
+    if(l == r)
+        return true;
+    if(l->length != r->length || (l->hash && r->hash && l->hash != r->hash))
+        return false;
+    return left.as_string() == right.as_string();
+}
+
+void Value::flatten(String& string) {
+    std::string text;
+    text.reserve(string.length);
+    // Leaves in order, without recursing: a string built by appending is a rope as deep as it is long
+    std::vector<const String*> pending{string.right, string.left};
+    while(!pending.empty()) {
+        const auto* node = pending.back();
+        pending.pop_back();
+        if(node->left) {
+            pending.push_back(node->right);
+            pending.push_back(node->left);
+        } else
+            text += node->text;
+    }
+    string.text = std::move(text);
+    release(std::exchange(string.left, nullptr));
+    release(std::exchange(string.right, nullptr));
+}
+
+void Value::release(String* string) {
+    if(--string->references == 0)
+        destroy(string);
+}
+
+void Value::destroy(String* string) {
+    if(!string->left) {
+        delete string;
+        return;
+    }
+    // Iterative for the same reason as flattening
+    std::vector<String*> dead{string};
+    while(!dead.empty()) {
+        auto* node = dead.back();
+        dead.pop_back();
+        for(auto* child : {node->left, node->right})
+            if(child && --child->references == 0)
+                dead.push_back(child);
+        delete node;
+    }
+}
+
+void Value::destroy() const {
+    if((bits & ~PAYLOAD) == box(STRING, 0))
+        destroy(static_cast<String*>(object()));
+    else
+        delete static_cast<Function*>(object());
+}
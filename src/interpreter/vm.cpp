@@ -0,0 +1,283 @@
+#include "interpreter/vm.hpp"
+
+#include "interpreter/compiler.hpp"
+#include "types/error_code.hpp"
+#include "utils/errorx.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iterator>
+#include <optional>
+
+// GCC and Clang jump from each handler straight to the next one through a table of label addresses,
+// sparing the bounds check and the shared indirect branch of a switch. Other compilers use the switch.
+#if defined(__GNUC__)
+#define KOBY_COMPUTED_GOTO 1
+#else
+#define KOBY_COMPUTED_GOTO 0
+#endif
+
+void Vm::run(const Program& program) {
+    const auto script = Compiler::compile(program);
+    registers.clear();
+    frames.clear();
+    ensure(script->registers);
+    frames.push_back(Frame{script.get(), script->code.data(), 0, interpreter.globals(), 0, nullptr});
+    execute();
+}
+
+const Chunk& Vm::compiled(const Func& func) {
+    const auto* key = &func.ast->body(func.body);
+    if(const auto it = chunks.find(key); it != chunks.end())
+        return *it->second;
+    const auto body = interpreter.function_body(*func.ast, func.body);
+    return *chunks.emplace(key, Compiler::compile(body, func.ast->list(func.params))).first->second;
+}
+
+void Vm::ensure(const size_t size) {
+    if(registers.size() < size)
+        registers.resize(std::max(size, registers.size() * 2));
+}
+
+void Vm::execute() {
+    const auto&  globals = interpreter.globals();
+    Frame*       frame   = &frames.back();
+    const Chunk* chunk   = frame->chunk;
+    const Instr* ip      = frame->ip;
+    const Instr* in      = nullptr;
+    Value*       R       = registers.data() + frame->base;
+    Value        result;
+
+    const auto line = [&] { return chunk->lines[in - chunk->code.data()]; };
+    const auto jump = [&] { ip = chunk->code.data() + in->bx(); };
+
+#if KOBY_COMPUTED_GOTO
+    // In the order of Op
+    static void* const labels[] = {
+        &&op_LOADK,         &&op_LOADNIL,       &&op_MOVE,          &&op_ADD,
+        &&op_SUBTRACT,      &&op_MULTIPLY,      &&op_DIVIDE,        &&op_MODULO,
+        &&op_GREATER,       &&op_GREATER_EQUAL, &&op_LESS,          &&op_LESS_EQUAL,
+        &&op_EQUAL,         &&op_NOT_EQUAL,     &&op_NEGATE,        &&op_NOT,
+        &&op_JUMP,          &&op_JUMP_IF,       &&op_JUMP_IF_NOT,   &&op_GET_GLOBAL,
+        &&op_SET_GLOBAL,    &&op_DEFINE_GLOBAL, &&op_GET_ENV,       &&op_SET_ENV,
+        &&op_DEFINE_ENV,    &&op_DUPLICATE,     &&op_ENTER,         &&op_LEAVE,
+        &&op_CLOSURE,       &&op_CHECK_CALL,    &&op_CALL,          &&op_TAIL_CALL,
+        &&op_RETURN,
+    };
+    static_assert(std::size(labels) == OP_COUNT);
+#define VM_CASE(name) op_##name:
+#define VM_NEXT()                                   \
+    do {                                            \
+        in = ip++;                                  \
+        goto* labels[static_cast<size_t>(in->op)];  \
+    } while(false)
+    VM_NEXT();
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() goto dispatch
+dispatch:
+    in = ip++;
+    switch(in->op) {
+#endif
+
+// Numbers are added, compared and so on right away, any other operands go through the interpreter's operator
+#define VM_BINARY(name, expression)                                                   \
+    VM_CASE(name) {                                                                   \
+        const Value& left  = R[in->b];                                                \
+        const Value& right = R[in->c];                                                \
+        if(left.is_number() && right.is_number()) {                                   \
+            const double l = left.as_number();                                        \
+            const double r = right.as_number();                                       \
+            R[in->a]       = expression;                                              \
+        } else                                                                        \
+            R[in->a] = Interpreter::binary(BinaryOp::name, left, right, line());      \
+        VM_NEXT();                                                                    \
+    }
+
+    VM_CASE(LOADK) {
+        R[in->a] = chunk->constants[in->bx()];
+        VM_NEXT();
+    }
+    VM_CASE(LOADNIL) {
+        R[in->a] = nullptr;
+        VM_NEXT();
+    }
+    VM_CASE(MOVE) {
+        R[in->a] = R[in->b];
+        VM_NEXT();
+    }
+    VM_BINARY(ADD, l + r)
+    VM_BINARY(SUBTRACT, l - r)
+    VM_BINARY(MULTIPLY, l * r)
+    VM_BINARY(DIVIDE, l / r)
+    VM_BINARY(MODULO, std::fmod(l, r))
+    VM_BINARY(GREATER, l > r)
+    VM_BINARY(GREATER_EQUAL, l >= r)
+    VM_BINARY(LESS, l < r)
+    VM_BINARY(LESS_EQUAL, l <= r)
+    VM_BINARY(EQUAL, l == r)
+    VM_BINARY(NOT_EQUAL, l != r)
+    VM_CASE(NEGATE) {
+        if(R[in->b].is_number())
+            R[in->a] = -R[in->b].as_number();
+        else
+            R[in->a] = Interpreter::unary(UnaryOp::NEGATE, R[in->b], line());
+        VM_NEXT();
+    }
+    VM_CASE(NOT) {
+        R[in->a] = !Interpreter::is_truthy(R[in->b]);
+        VM_NEXT();
+    }
+    VM_CASE(JUMP) {
+        jump();
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF) {
+        if(Interpreter::is_truthy(R[in->a]))
+            jump();
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_NOT) {
+        if(!Interpreter::is_truthy(R[in->a]))
+            jump();
+        VM_NEXT();
+    }
+    VM_CASE(GET_GLOBAL) {
+        R[in->a] = globals->get(chunk->names[in->bx()].symbol);
+        VM_NEXT();
+    }
+    VM_CASE(SET_GLOBAL) {
+        globals->assign(chunk->names[in->bx()].symbol, R[in->a]);
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_GLOBAL) {
+        globals->define(chunk->names[in->bx()], R[in->a]);
+        VM_NEXT();
+    }
+    VM_CASE(GET_ENV) {
+        const auto& lookup = chunk->lookups[in->bx()];
+        for(const auto coord : lookup.coords) {
+            if(const auto& slot = frame->env->at(coord)) {
+                R[in->a] = *slot;
+                VM_NEXT();
+            }
+        }
+        R[in->a] = globals->get(lookup.name);
+        VM_NEXT();
+    }
+    VM_CASE(SET_ENV) {
+        const auto& lookup = chunk->lookups[in->bx()];
+        for(const auto coord : lookup.coords) {
+            if(auto& slot = frame->env->at(coord)) {
+                *slot = R[in->a];
+                VM_NEXT();
+            }
+        }
+        globals->assign(lookup.name, R[in->a]);
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_ENV) {
+        frame->env->define(chunk->names[in->bx()], R[in->a]);
+        VM_NEXT();
+    }
+    VM_CASE(DUPLICATE) {
+        auto declared = std::optional<Value>(nullptr);
+        Environment::define(declared, chunk->names[in->bx()], R[in->a]);
+        VM_NEXT();
+    }
+    VM_CASE(ENTER) {
+        frame->env = std::make_shared<Environment>(frame->env, in->bx());
+        VM_NEXT();
+    }
+    VM_CASE(LEAVE) {
+        for(uint16_t k = 0; k < in->a; k++)
+            frame->env = frame->env->parent();
+        VM_NEXT();
+    }
+    VM_CASE(CLOSURE) {
+        const auto& proto = chunk->functions[in->bx()];
+        if(proto.lambda)
+            R[in->a] = std::shared_ptr<Callable>(
+                std::make_shared<LambdaFunc>(chunk->ast, proto.params, proto.body, frame->env));
+        else
+            R[in->a] = std::shared_ptr<Callable>(
+                std::make_shared<Func>(chunk->ast, proto.params, proto.body, frame->env, proto.name));
+        VM_NEXT();
+    }
+    VM_CASE(CHECK_CALL) {
+        if(!R[in->a].is_callable())
+            throw err::make(err::NOT_CALLABLE, "Can only call functions.", line());
+        const auto& callable = R[in->a].as_callable();
+        if(in->b != callable->arity())
+            throw err::make(
+                err::ARGUMENT_COUNT_MISMATCH,
+                std::format("Expected {} arguments but got {}.", callable->arity(), in->b),
+                line());
+        VM_NEXT();
+    }
+    VM_CASE(CALL) {
+        auto callee = R[in->a].as_callable();
+        if(const auto* func = dynamic_cast<const Func*>(callee.get())) {
+            const Chunk& target = compiled(*func);
+            const size_t base   = frame->base + in->a + 1;
+            frame->ip           = ip;
+            ensure(base + target.registers);
+            frames.push_back(Frame{&target, target.code.data(), base, func->closure, base - 1, std::move(callee)});
+            frame = &frames.back();
+            chunk = &target;
+            ip    = target.code.data();
+            R     = registers.data() + base;
+            VM_NEXT();
+        }
+        const std::vector<Value> arguments(R + in->a + 1, R + in->a + 1 + in->b);
+        result   = callee->call(interpreter, arguments).value;
+        R[in->a] = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(TAIL_CALL) {
+        auto callee = R[in->a].as_callable();
+        if(const auto* func = dynamic_cast<const Func*>(callee.get())) {
+            // The arguments move down to the first registers, where the callee's parameters are
+            const Chunk& target = compiled(*func);
+            for(uint16_t k = 0; k < in->b; k++)
+                R[k] = std::move(R[in->a + 1 + k]);
+            ensure(frame->base + target.registers);
+            frame->chunk  = &target;
+            frame->env    = func->closure;
+            frame->callee = std::move(callee);
+            chunk         = &target;
+            ip            = target.code.data();
+            R             = registers.data() + frame->base;
+            VM_NEXT();
+        }
+        const std::vector<Value> arguments(R + in->a + 1, R + in->a + 1 + in->b);
+        result = callee->call(interpreter, arguments).value;
+        goto finish;
+    }
+    VM_CASE(RETURN) {
+        result = std::move(R[in->a]);
+        goto finish;
+    }
+
+#if !KOBY_COMPUTED_GOTO
+    }
+#endif
+
+finish: {
+    const size_t ret = frame->ret;
+    frames.pop_back();
+    if(frames.empty())
+        return;
+    frame          = &frames.back();
+    chunk          = frame->chunk;
+    ip             = frame->ip;
+    R              = registers.data() + frame->base;
+    registers[ret] = std::move(result);
+    VM_NEXT();
+}
+
+#undef VM_BINARY
+#undef VM_NEXT
+#undef VM_CASE
+}
@@ -1,18 +1,47 @@
 #include "const/cmd.hpp"
 #include "const/prelude_func.hpp"
+#include "interpreter/closure.hpp"
+#include "interpreter/incremental.hpp"
 #include "interpreter/interpreter.hpp"
+#include "interpreter/jit.hpp"
+#include "interpreter/optimizer.hpp"
 #include "interpreter/parser.hpp"
+#include "interpreter/resolver.hpp"
 #include "interpreter/scanner.hpp"
+#include "interpreter/vm.hpp"
 #include "print/printer.hpp"
 #include "utils/file.hpp"
 
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <format>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
+
+/* Engines `koby run` executes a program with: walking its tree, compiling it to bytecode for the VM or to closures */
+enum class Engine {
+    TREE,
+    VM,
+    CLOSURE,
+};
+
+/* Flags of `koby run`, given before the file path */
+struct RunOptions {
+    bool   dump_opt     = false;
+    size_t inline_limit = Inliner::DEFAULT_LIMIT;
+    Engine engine       = Engine::TREE;
+    bool   jit          = false;
+};
 
 int procCmdHelp();
-int procCmdRun(const std::string& path);
+int procCmdRun(const std::string& path, const RunOptions& options);
 int procCmdRepl();
+int procCmdCheck(const std::string& path, bool watch);
+int runParsed(const ParseResult& parse_res, const RunOptions& options);
 
 int main(const int argc, char* argv[]) {
     if(argc < 2) {
@@ -25,17 +54,61 @@ int main(const int argc, char* argv[]) {
     }
 
     if(argv[1] == cmd::RUN) {
-        if(argc < 3) {
-            std::cerr << "Usage: koby run <filename>" << std::endl;
+        auto options = RunOptions{};
+        int  arg     = 2;
+        for(; arg < argc - 1; arg++) {
+            const std::string_view flag = argv[arg];
+            if(flag == cmd::DUMP_OPT) {
+                options.dump_opt = true;
+                continue;
+            }
+            if(flag == cmd::JIT) {
+                options.jit = true;
+                continue;
+            }
+            if(flag.starts_with(cmd::INLINE_LIMIT)) {
+                const auto value     = flag.substr(cmd::INLINE_LIMIT.size());
+                const auto end       = value.data() + value.size();
+                const auto [ptr, ec] = std::from_chars(value.data(), end, options.inline_limit);
+                if(ec == std::errc() && ptr == end)
+                    continue;
+            }
+            if(flag.starts_with(cmd::ENGINE)) {
+                const auto engine = flag.substr(cmd::ENGINE.size());
+                if(engine == cmd::ENGINE_TREE || engine == cmd::ENGINE_VM || engine == cmd::ENGINE_CLOSURE) {
+                    options.engine = engine == cmd::ENGINE_VM        ? Engine::VM
+                                     : engine == cmd::ENGINE_CLOSURE ? Engine::CLOSURE
+                                                                     : Engine::TREE;
+                    continue;
+                }
+            }
+            break;
+        }
+        if(arg != argc - 1) {
+            std::cerr << "Usage: koby run [--dump-opt] [--inline-limit=N] [--engine=tree|vm|closure] [--jit] <filename>"
+                      << std::endl;
             return EXIT_FAILURE;
         }
-        return procCmdRun(argv[2]);
+        return procCmdRun(argv[arg], options);
     }
 
     if(argv[1] == cmd::REPL) {
         return procCmdRepl();
     }
 
+    if(argv[1] == cmd::CHECK) {
+        if(argc < 3) {
+            std::cerr << "Usage: koby check [--watch] <filename>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        const bool watch = argv[2] == cmd::WATCH;
+        if(watch && argc < 4) {
+            std::cerr << "Usage: koby check [--watch] <filename>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return procCmdCheck(argv[watch ? 3 : 2], watch);
+    }
+
     std::cerr << "Unknown command: " << argv[1] << std::endl;
     return EXIT_FAILURE;
 }
@@ -45,30 +118,102 @@ int procCmdHelp() {
     std::cout << "Commands:" << std::endl;
     std::cout << "  help - Display this help message." << std::endl;
     std::cout << "  run  - Run the code from file path." << std::endl;
+    std::cout << "  run --dump-opt - Print what the optimizer folded, removed and inlined, then run." << std::endl;
+    std::cout << "  run --inline-limit=N - Inline functions of at most N nodes, 0 disables inlining." << std::endl;
+    std::cout << "  run --engine=vm - Compile to bytecode and run it on the register VM." << std::endl;
+    std::cout << "  run --engine=closure - Compile to pre-bound C++ closures and run them." << std::endl;
+    std::cout << "  run --jit - Compile hot numeric functions to machine code, the tree engine only." << std::endl;
     std::cout << "  repl - Start the REPL." << std::endl;
     std::cout << "       - Type 'exit' to exit the REPL." << std::endl;
+    std::cout << "  check [--watch] - Report the errors in the file without running it." << std::endl;
+    std::cout << "                  - With --watch, recheck on every save, reparsing only what changed." << std::endl;
     return EXIT_SUCCESS;
 }
 
-int procCmdRun(const std::string& path) {
-    auto       scanner  = Scanner::from_source(utils::read_file_contents(path));
-    const auto scan_res = scanner.scan_tokens();
+int procCmdRun(const std::string& path, const RunOptions& options) {
+    const bool dump_opt = options.dump_opt;
+    // Mapped for the whole run, every token and AST name is a view into it
+    const auto source = utils::SourceBuffer::map_file(path);
+
+    // Huge sources are scanned on every core up front, smaller ones stream their tokens into the parser
+    if(source.view().size() >= Scanner::PARALLEL_MIN_SIZE) {
+        auto scan_res = Scanner::scan_parallel(source.view(), std::thread::hardware_concurrency());
+        if(!std::get<1>(scan_res).empty()) {
+            printer::print_res_err(scan_res);
+            return EXIT_FAILURE;
+        }
+        auto parser = Parser::from_tokens(std::move(std::get<0>(scan_res)));
+        if(!dump_opt)
+            parser.defer_bodies(source.view());
+        return runParsed(parser.parse(), options);
+    }
+
+    auto scanner = Scanner::from_source(source.view());
+    auto parser  = Parser::from_source(scanner);
+    // Function bodies are only parsed once called, most library code never is.
+    // A dump covers every body, so they are all parsed up front then.
+    if(!dump_opt)
+        parser.defer_bodies(source.view());
+    const auto parse_res = parser.parse();
+    // Scanner errors still take precedence over parser errors
     if(!scanner.success()) {
-        printer::print_res_err(scan_res);
+        printer::print_err(scanner.collected_errors());
         return EXIT_FAILURE;
     }
-    auto       parser    = Parser::from_tokens(std::get<0>(scan_res));
-    const auto parse_res = parser.parse();
-    if(!parser.success()) {
+    return runParsed(parse_res, options);
+}
+
+int runParsed(const ParseResult& parse_res, const RunOptions& options) {
+    const bool dump_opt = options.dump_opt;
+    if(!std::get<1>(parse_res).empty()) {
         printer::print_res_err(parse_res);
         return EXIT_FAILURE;
     }
+    auto report = OptimizeReport{};
+    Optimizer::optimize(std::get<0>(parse_res), dump_opt ? &report : nullptr);
+    if(dump_opt) {
+        for(const auto& [line, before, after] : report.folded)
+            std::cout << std::format("[line {}] {} => {}", line, before, after) << std::endl;
+        std::cout << std::format("{} expression(s) folded", report.folded.size()) << std::endl;
+        std::cout << std::format("{} node(s) removed as dead code", report.removed) << std::endl;
+        for(const auto& [line, before, after] : report.hoisted)
+            std::cout << std::format("[line {}] {} hoisted as {}", line, before, after) << std::endl;
+        std::cout << std::format("{} expression(s) hoisted out of loops", report.hoisted.size()) << std::endl;
+    }
+    auto interp = Interpreter(options.inline_limit);
+    auto jit    = Jit(interp);
+    if(options.jit && options.engine == Engine::TREE)
+        interp.use_jit(&jit);
+    // Reported on stderr, the program's output stays the same with the JIT
+    const auto report_jit = [&] {
+        if(!options.jit || options.engine != Engine::TREE)
+            return;
+        const auto [compiled, bailouts, deoptimized] = jit.statistics();
+        std::cerr << std::format(
+                         "jit: {} function(s) compiled, {} bailout(s), {} deoptimized", compiled, bailouts, deoptimized)
+                  << std::endl;
+    };
     try {
-        Interpreter().interpret(std::get<0>(parse_res));
+        Resolver::resolve(std::get<0>(parse_res));
+        // The VM and the closures make every call, inlining only speeds up the tree-walker
+        if(options.engine == Engine::VM) {
+            Vm(interp).run(std::get<0>(parse_res));
+            return EXIT_SUCCESS;
+        }
+        if(options.engine == Engine::CLOSURE) {
+            ClosureEngine(interp).run(std::get<0>(parse_res));
+            return EXIT_SUCCESS;
+        }
+        const size_t inlined = interp.inline_calls(std::get<0>(parse_res));
+        if(dump_opt)
+            std::cout << std::format("{} call(s) inlined", inlined) << std::endl;
+        interp.interpret(std::get<0>(parse_res));
     } catch(Error& error) {
         printer::print_err(error);
+        report_jit();
         return EXIT_FAILURE;
     }
+    report_jit();
     return EXIT_SUCCESS;
 }
 
@@ -76,6 +221,8 @@ int procCmdRepl() {
     std::cout << "Koby REPL" << std::endl;
     std::string input;
     auto        interp = Interpreter();
+    // Every line stays alive, functions defined on earlier lines keep views into it
+    std::vector<utils::SourceBuffer> lines;
     interp.exclude_native_func({prelude::PUT, prelude::GET});
     while(true) {
         std::cout << "\033[1;32m>>> \033[0m";
@@ -90,19 +237,23 @@ int procCmdRepl() {
         if(input.back() != symbol::Semicolon)
             input += symbol::Semicolon;
 
-        auto       scanner  = Scanner::from_source(input);
-        const auto scan_res = scanner.scan_tokens();
+        const auto& line      = lines.emplace_back(utils::SourceBuffer::from_string(input));
+        auto        scanner   = Scanner::from_source(line.view());
+        auto        parser    = Parser::from_source(scanner);
+        parser.defer_bodies(line.view());
+        const auto parse_res = parser.parse();
         if(!scanner.success()) {
-            printer::print_res_err(scan_res);
+            printer::print_err(scanner.collected_errors());
             continue;
         }
-        auto       parser    = Parser::from_tokens(std::get<0>(scan_res));
-        const auto parse_res = parser.parse();
         if(!parser.success()) {
             printer::print_res_err(parse_res);
             continue;
         }
         try {
+            Optimizer::optimize(std::get<0>(parse_res));
+            Resolver::resolve(std::get<0>(parse_res));
+            interp.inline_calls(std::get<0>(parse_res));
             auto [control, value] = interp.interpret(std::get<0>(parse_res));
             printer::print(value);
         } catch(Error& error) {
@@ -111,3 +262,36 @@ int procCmdRepl() {
     }
     return EXIT_SUCCESS;
 }
+
+int procCmdCheck(const std::string& path, const bool watch) {
+    constexpr auto poll_interval = std::chrono::milliseconds(100);
+
+    auto                            session = IncrementalParser();
+    std::filesystem::file_time_type checked{};
+    while(true) {
+        std::error_code ec;
+        const auto      modified = std::filesystem::last_write_time(path, ec);
+        if(watch && (ec || modified == checked)) {
+            std::this_thread::sleep_for(poll_interval);
+            continue;
+        }
+        checked = modified;
+
+        // Copied rather than mapped, an editor may truncate the file while it is being checked
+        const auto source = utils::SourceBuffer::read_file(path);
+        const auto stats  = session.update(source.view());
+        const auto errors = session.collected_errors();
+        printer::print_err(errors);
+        if(!watch)
+            return errors.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        std::cout << std::format(
+                         "{} error(s), {} declaration(s) reparsed, {} reused{} in {:.3f} ms",
+                         errors.size(),
+                         stats.reparsed,
+                         stats.reused,
+                         stats.compacted ? " after compaction" : "",
+                         static_cast<double>(stats.elapsed.count()) / 1000.0)
+                  << std::endl;
+    }
+}
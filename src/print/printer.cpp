@@ -10,7 +10,7 @@ void print(const Value& value) {
     if(const auto str = utils::to_string(value); str.empty())
         std::cout << "\033[3m<empty>\033[0m" << std::endl;
     else
-        std::cout << utils::to_string(value) << std::endl;
+        std::cout << str << std::endl;
 }
 
 void print_waring(const Error& error) {
@@ -1,23 +1,121 @@
-#include <fstream>
+#include "utils/file.hpp"
+
+#include <cerrno>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace utils {
 
-std::string read_file_contents(const std::string& path) {
+namespace {
+
+[[noreturn]] void fail(const std::string& path) {
+    std::cerr << "Error reading file: " << path << std::endl;
+    std::exit(1);
+}
+
+int open_file(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        fail(path);
+    return fd;
+}
+
+/* Reads `fd` to its end, for files that are not mapped */
+std::string read_all(const int fd, const std::string& path) {
+    std::string text;
+    char        chunk[1 << 16];
+    while(true) {
+        const ssize_t count = read(fd, chunk, sizeof chunk);
+        if(count == 0)
+            return text;
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+            close(fd);
+            fail(path);
+        }
+        text.append(chunk, count);
+    }
+}
+
+} // namespace
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+    : bytes(std::exchange(other.bytes, nullptr)), length(std::exchange(other.length, 0)),
+      mapped(std::exchange(other.mapped, false)), owned(std::move(other.owned)) {}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if(this != &other) {
+        if(mapped)
+            munmap(const_cast<char*>(bytes), length);
+        bytes  = std::exchange(other.bytes, nullptr);
+        length = std::exchange(other.length, 0);
+        mapped = std::exchange(other.mapped, false);
+        owned  = std::move(other.owned);
+    }
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if(mapped)
+        munmap(const_cast<char*>(bytes), length);
+}
+
+SourceBuffer SourceBuffer::map_file(const std::string& path) {
+    const int fd = open_file(path);
+    struct stat info {};
+    if(fstat(fd, &info) != 0) {
+        close(fd);
+        fail(path);
+    }
 
-    std::ifstream file(path);
-    if(!file.is_open()) {
-        std::cerr << "Error reading file: " << path << std::endl;
-        std::exit(1);
+    // Mapping zero bytes is an error, and pipes, FIFOs or /dev/stdin report a size of 0 whatever they hold,
+    // so only regular files with content are mapped, anything else is read
+    if(!S_ISREG(info.st_mode) || info.st_size == 0) {
+        const auto text = read_all(fd, path);
+        close(fd);
+        return from_string(text);
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
+    void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED)
+        fail(path);
+    // Only a hint for the kernel's read-ahead, a refused one leaves the mapping readable all the same
+    (void)madvise(addr, info.st_size, MADV_SEQUENTIAL);
+
+    auto buffer   = SourceBuffer();
+    buffer.bytes  = static_cast<const char*>(addr);
+    buffer.length = info.st_size;
+    buffer.mapped = true;
+    return buffer;
+}
+
+SourceBuffer SourceBuffer::read_file(const std::string& path) {
+    const int  fd   = open_file(path);
+    const auto text = read_all(fd, path);
+    close(fd);
+    return from_string(text);
+}
+
+SourceBuffer SourceBuffer::from_string(const std::string_view text) {
+    auto buffer  = SourceBuffer();
+    buffer.owned = std::make_unique<char[]>(text.size());
+    std::memcpy(buffer.owned.get(), text.data(), text.size());
+    buffer.bytes  = buffer.owned.get();
+    buffer.length = text.size();
+    return buffer;
+}
 
-    return buffer.str();
+std::string_view SourceBuffer::view() const {
+    return {bytes, length};
 }
 
-}
\ No newline at end of file
+} // namespace utils
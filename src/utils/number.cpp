@@ -0,0 +1,53 @@
+#include "utils/number.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <cmath>
+
+namespace utils {
+
+double parse_number_literal(const std::string_view text) {
+    double value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+std::optional<double> parse_number(std::string_view text) {
+    while(!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+        text.remove_prefix(1);
+
+    bool negative = false;
+    if(!text.empty() && (text.front() == '+' || text.front() == '-')) {
+        negative = text.front() == '-';
+        text.remove_prefix(1);
+    }
+    // from_chars takes neither a sign nor the 0x prefix, both are handled here
+    auto format = std::chars_format::general;
+    if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        format = std::chars_format::hex;
+        text.remove_prefix(2);
+    }
+    if(text.empty() || text.front() == '+' || text.front() == '-')
+        return std::nullopt;
+
+    double     value = 0;
+    const auto end   = text.data() + text.size();
+    if(const auto [ptr, ec] = std::from_chars(text.data(), end, value, format); ec != std::errc() || ptr != end)
+        return std::nullopt;
+    return negative ? -value : value;
+}
+
+NumberText format_number(const double number) {
+    NumberText text;
+    const auto precision = std::floor(number) == number ? 0 : 6;
+    const auto [ptr, ec] =
+        std::to_chars(text.chars.data(), text.chars.data() + text.chars.size(), number, std::chars_format::fixed, precision);
+    text.length = ptr - text.chars.data();
+    return text;
+}
+
+void append_number(std::string& out, const double number) {
+    out += format_number(number).view();
+}
+
+} // namespace utils
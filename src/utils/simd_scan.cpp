@@ -0,0 +1,186 @@
+#include "utils/simd_scan.hpp"
+
+#include "const/characters.hpp"
+#include "utils/validation.hpp"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+namespace {
+
+bool is_blank(const char c) {
+    return c == delimiter::SPACE || c == delimiter::TAB;
+}
+
+// The scanner treats the EOF byte as the end of the source, so the searches stop on it as well
+bool ends_comment(const char c) {
+    return c == delimiter::NEWLINE || c == delimiter::ENDOF;
+}
+
+bool ends_string(const char c) {
+    return c == surround::DoubleQuote || c == delimiter::ENDOF;
+}
+
+/*
+ Per instruction set primitives over a block of bytes. A comparison yields 0xFF in every
+ matching byte and `bits` packs one bit per byte, the scalar fallback is a block of one byte.
+ */
+#if defined(__AVX2__)
+using Block                 = __m256i;
+constexpr size_t BLOCK_SIZE = 32;
+
+Block load(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+Block splat(const char c) {
+    return _mm256_set1_epi8(c);
+}
+Block eq(const Block a, const Block b) {
+    return _mm256_cmpeq_epi8(a, b);
+}
+Block either(const Block a, const Block b) {
+    return _mm256_or_si256(a, b);
+}
+Block add(const Block a, const Block b) {
+    return _mm256_add_epi8(a, b);
+}
+Block less(const Block a, const Block b) {
+    return _mm256_cmpgt_epi8(b, a);
+}
+uint32_t bits(const Block a) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(a));
+}
+#elif defined(__SSE2__)
+using Block                 = __m128i;
+constexpr size_t BLOCK_SIZE = 16;
+
+Block load(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+Block splat(const char c) {
+    return _mm_set1_epi8(c);
+}
+Block eq(const Block a, const Block b) {
+    return _mm_cmpeq_epi8(a, b);
+}
+Block either(const Block a, const Block b) {
+    return _mm_or_si128(a, b);
+}
+Block add(const Block a, const Block b) {
+    return _mm_add_epi8(a, b);
+}
+Block less(const Block a, const Block b) {
+    return _mm_cmplt_epi8(a, b);
+}
+uint32_t bits(const Block a) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(a));
+}
+#else
+using Block                 = uint8_t;
+constexpr size_t BLOCK_SIZE = 1;
+
+Block load(const char* p) {
+    return static_cast<Block>(*p);
+}
+Block splat(const char c) {
+    return static_cast<Block>(c);
+}
+Block eq(const Block a, const Block b) {
+    return a == b ? 0xFF : 0;
+}
+Block either(const Block a, const Block b) {
+    return a | b;
+}
+Block add(const Block a, const Block b) {
+    return static_cast<Block>(a + b);
+}
+Block less(const Block a, const Block b) {
+    return static_cast<int8_t>(a) < static_cast<int8_t>(b) ? 0xFF : 0;
+}
+uint32_t bits(const Block a) {
+    return a & 1;
+}
+#endif
+
+constexpr uint32_t FULL_MASK = BLOCK_SIZE == 32 ? 0xFFFFFFFFu : (1u << BLOCK_SIZE) - 1;
+
+/*
+ Bytes within [lo, hi], using a signed compare after shifting lo down to -128
+ since SSE2 has no unsigned byte compare
+ */
+Block in_range(const Block v, const char lo, const char hi) {
+    const auto shifted = add(v, splat(static_cast<char>(0x80 - lo)));
+    return less(shifted, splat(static_cast<char>(-128 + (hi - lo + 1))));
+}
+
+/*
+ Walks whole blocks until `stops` reports a stopping byte, the tail shorter than a block
+ is finished by the scalar predicate so no load ever reads past the text
+ */
+template <class BlockStops, class ByteStops>
+size_t find_stop(const std::string_view text, size_t from, BlockStops stops, ByteStops byte_stops) {
+    const char* data = text.data();
+    while(from + BLOCK_SIZE <= text.size()) {
+        if(const uint32_t mask = stops(load(data + from)); mask != 0)
+            return from + std::countr_zero(mask);
+        from += BLOCK_SIZE;
+    }
+    while(from < text.size() && !byte_stops(data[from]))
+        from++;
+    return from;
+}
+
+} // namespace
+
+size_t skip_blanks(const std::string_view text, const size_t from) {
+    return find_stop(
+        text,
+        from,
+        [](const Block block) {
+            const auto blanks = either(eq(block, splat(delimiter::SPACE)), eq(block, splat(delimiter::TAB)));
+            return ~bits(blanks) & FULL_MASK;
+        },
+        [](const char c) { return !is_blank(c); });
+}
+
+size_t skip_to_line_end(const std::string_view text, const size_t from) {
+    return find_stop(
+        text,
+        from,
+        [](const Block block) {
+            return bits(either(eq(block, splat(delimiter::NEWLINE)), eq(block, splat(delimiter::ENDOF))));
+        },
+        ends_comment);
+}
+
+size_t skip_to_quote(const std::string_view text, const size_t from) {
+    return find_stop(
+        text,
+        from,
+        [](const Block block) {
+            return bits(either(eq(block, splat(surround::DoubleQuote)), eq(block, splat(delimiter::ENDOF))));
+        },
+        ends_string);
+}
+
+size_t skip_identifier_chars(const std::string_view text, const size_t from) {
+    return find_stop(
+        text,
+        from,
+        [](const Block block) {
+            // Setting bit 0x20 folds upper case letters onto lower case ones
+            const auto letters = in_range(either(block, splat(0x20)), 'a', 'z');
+            const auto digits  = in_range(block, '0', '9');
+            const auto ident   = either(either(letters, digits), eq(block, splat('_')));
+            return ~bits(ident) & FULL_MASK;
+        },
+        [](const char c) { return !is_identifier_char(c); });
+}
+
+} // namespace utils
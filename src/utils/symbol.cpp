@@ -0,0 +1,48 @@
+#include "utils/symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+struct SymbolTable {
+    std::shared_mutex mutex;
+    // A deque never moves its elements, so the views used as map keys stay valid
+    std::deque<std::string>                        names{std::string()};
+    std::unordered_map<std::string_view, uint32_t> ids{{names.front(), 0}};
+};
+
+SymbolTable& table() {
+    static SymbolTable instance;
+    return instance;
+}
+
+} // namespace
+
+Symbol Symbol::intern(const std::string_view name) {
+    auto&      symbols = table();
+    const auto hash    = static_cast<uint32_t>(std::hash<std::string_view>{}(name));
+    {
+        std::shared_lock lock(symbols.mutex);
+        if(const auto it = symbols.ids.find(name); it != symbols.ids.end())
+            return Symbol{it->second, hash};
+    }
+
+    std::unique_lock lock(symbols.mutex);
+    // Another thread may have interned the name between the two locks
+    if(const auto it = symbols.ids.find(name); it != symbols.ids.end())
+        return Symbol{it->second, hash};
+    const auto  id     = static_cast<uint32_t>(symbols.names.size());
+    const auto& stored = symbols.names.emplace_back(name);
+    symbols.ids.emplace(stored, id);
+    return Symbol{id, hash};
+}
+
+std::string_view Symbol::name() const {
+    auto&            symbols = table();
+    std::shared_lock lock(symbols.mutex);
+    return symbols.names[id];
+}
@@ -1,11 +1,10 @@
+#include "utils/to_string.hpp"
+
 #include "const/characters.hpp"
 #include "interpreter/interpreter.hpp"
 #include "types/token_t.hpp"
-#include "utils/templ.hpp"
+#include "utils/number.hpp"
 
-#include <cmath>
-#include <iomanip>
-#include <sstream>
 #include <string>
 
 namespace utils {
@@ -99,23 +98,22 @@ std::string to_string(const TokenType type) {
 }
 
 std::string to_string(const Value& value) {
-    return std::visit<std::string>(
-        overloaded{
-            [](std::nullptr_t) { return keyword::Nil; },
-            [](const double num) {
-                std::ostringstream ss;
-                if(std::floor(num) == num) {
-                    ss << std::fixed << std::setprecision(0) << num;
-                } else {
-                    ss << std::fixed << num;
-                }
-                return ss.str();
-            },
-            [](const std::string& str) { return str; },
-            [](const bool boolean) { return boolean ? keyword::True : keyword::False; },
-            [](const std::shared_ptr<Callable>& callable) { return callable->to_string(); },
-        },
-        value);
+    std::string text;
+    append_string(text, value);
+    return text;
+}
+
+void append_string(std::string& out, const Value& value) {
+    if(value.is_number())
+        append_number(out, value.as_number());
+    else if(value.is_string())
+        out += value.as_string();
+    else if(value.is_bool())
+        out += value.as_bool() ? keyword::True : keyword::False;
+    else if(value.is_callable())
+        out += value.as_callable()->to_string();
+    else
+        out += keyword::Nil;
 }
 
 } // namespace utils
\ No newline at end of file
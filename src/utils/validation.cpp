@@ -1,13 +1,15 @@
-#include <locale>
+#include "const/lexicon.hpp"
+
+#include <cstddef>
 
 namespace utils {
 
 bool is_identifier_start(const char c) {
-    return std::isalpha(c) || c == '_';
+    return lexicon::is_identifier_start(c);
 }
 
 bool is_identifier_char(const char c) {
-    return std::isdigit(c) || is_identifier_start(c);
+    return lexicon::is_identifier_char(c);
 }
 
 bool invalid_arity(const size_t count) {